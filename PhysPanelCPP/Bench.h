@@ -0,0 +1,25 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+
+// Latency harness for the hot paths touched by boot-to-ready work. Each suite runs N timed iterations
+// and prints one JSON object with min/mean/p50/p95/p99/max in nanoseconds and the failure count.
+// Returns 0 only when every selected suite produced at least one successful sample.
+namespace Bench {
+    int Run(int argc, wchar_t* argv[]);
+}
\ No newline at end of file
@@ -0,0 +1,293 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "BootService.h"
+#include "Utils.h"
+#include "Trace.h"
+#include "PowerMonitor.h"
+#include <TlHelp32.h>
+
+namespace BootService {
+
+    constexpr auto SERVICE_DISPLAY_NAME = L"Xbox Full Screen Experience Tool Panel Override";
+    constexpr auto SERVICE_DESCRIPTION = L"Publishes the handheld panel dimension override early in boot and keeps it asserted.";
+    // Win32 services in a ServiceGroupOrder group start before every ungrouped auto-start service, and the
+    // SCM holds the rest of the group order until this one leaves START_PENDING. "Video" precedes
+    // ProfSvc_Group, so the override is in place before any user profile (and shell) can load.
+    constexpr auto SERVICE_LOAD_ORDER_GROUP = L"Video";
+    const DWORD START_WAIT_HINT_MS = 3000;
+    const DWORD STOP_TIMEOUT_MS = 10000;
+
+    PanelManager::Dimensions g_target = { 0, 0 };
+    bool g_guardDeviceForm = false;
+    SERVICE_STATUS_HANDLE g_hServiceStatus = NULL;
+    SERVICE_STATUS g_serviceStatus = {};
+    HANDLE g_hStopEvent = NULL;
+    HANDLE g_hSessionChanged = NULL;
+
+    void ReportStatus(DWORD state, DWORD exitCode = NO_ERROR, DWORD waitHint = 0) {
+        g_serviceStatus.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+        g_serviceStatus.dwCurrentState = state;
+        g_serviceStatus.dwWin32ExitCode = exitCode;
+        g_serviceStatus.dwWaitHint = waitHint;
+        g_serviceStatus.dwControlsAccepted = (state == SERVICE_RUNNING)
+            ? SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN | SERVICE_ACCEPT_SESSIONCHANGE : 0;
+        if (state == SERVICE_RUNNING || state == SERVICE_STOPPED) g_serviceStatus.dwCheckPoint = 0;
+        else g_serviceStatus.dwCheckPoint++;
+        SetServiceStatus(g_hServiceStatus, &g_serviceStatus);
+    }
+
+    DWORD WINAPI ControlHandler(DWORD control, DWORD eventType, LPVOID eventData, LPVOID context) {
+        UNREFERENCED_PARAMETER(eventType);
+        UNREFERENCED_PARAMETER(eventData);
+        UNREFERENCED_PARAMETER(context);
+
+        switch (control) {
+        case SERVICE_CONTROL_STOP:
+        case SERVICE_CONTROL_SHUTDOWN:
+            ReportStatus(SERVICE_STOP_PENDING, NO_ERROR, STOP_TIMEOUT_MS);
+            SetEvent(g_hStopEvent);
+            return NO_ERROR;
+        case SERVICE_CONTROL_SESSIONCHANGE:
+            SetEvent(g_hSessionChanged);
+            return NO_ERROR;
+        case SERVICE_CONTROL_INTERROGATE:
+            return NO_ERROR;
+        default:
+            return ERROR_CALL_NOT_IMPLEMENTED;
+        }
+    }
+
+    // Creation time of the first dwm.exe (one per session). Returns false while none is running.
+    bool GetFirstDwmStartTime(ULONGLONG& startTime) {
+        HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+        if (hSnapshot == INVALID_HANDLE_VALUE) return false;
+
+        startTime = 0;
+        PROCESSENTRY32W entry = { sizeof(entry) };
+        for (BOOL more = Process32FirstW(hSnapshot, &entry); more; more = Process32NextW(hSnapshot, &entry)) {
+            if (_wcsicmp(entry.szExeFile, L"dwm.exe") != 0) continue;
+
+            HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, entry.th32ProcessID);
+            if (!hProcess) continue;
+            ULONGLONG created = 0, exited = 0, kernel = 0, user = 0;
+            if (GetProcessTimes(hProcess, reinterpret_cast<FILETIME*>(&created), reinterpret_cast<FILETIME*>(&exited),
+                reinterpret_cast<FILETIME*>(&kernel), reinterpret_cast<FILETIME*>(&user))) {
+                if (!startTime || created < startTime) startTime = created;
+            }
+            CloseHandle(hProcess);
+        }
+        CloseHandle(hSnapshot);
+        return startTime != 0;
+    }
+
+    // Positive lead: the override was published before DWM started, so its first read saw it.
+    bool ReportDwmLead(ULONGLONG applyTime) {
+        ULONGLONG dwmStartTime = 0;
+        if (!GetFirstDwmStartTime(dwmStartTime)) return false;
+
+        LONGLONG leadMs = ((LONGLONG)dwmStartTime - (LONGLONG)applyTime) / 10000;
+        LogDebug(L"BootService: Override published %lld ms %s the first DWM started.", leadMs < 0 ? -leadMs : leadMs, leadMs >= 0 ? L"before" : L"after");
+        Trace::Milestone(L"BootService", leadMs >= 0 ? L"BeforeDwm" : L"AfterDwm", (DWORD)(leadMs < 0 ? -leadMs : leadMs));
+        return true;
+    }
+
+    void RunService() {
+        HANDLE hWatchMutex = CreateMutexW(NULL, TRUE, PanelManager::PANEL_WATCH_MUTEX_NAME);
+        if (hWatchMutex && GetLastError() == ERROR_ALREADY_EXISTS) {
+            // Another resident mode already owns the override. Keep serving so the SCM does not retry.
+            LogDebug(L"BootService: Watch mode already running. Override left to it.");
+            CloseHandle(hWatchMutex);
+            hWatchMutex = NULL;
+        }
+
+        // Publish first, before reporting running: this is the point of the service.
+        if (hWatchMutex) {
+            Trace::PhaseScope trace(L"BootService", L"ApplyOverride");
+            bool changed = false;
+            NTSTATUS status = PanelManager::ApplyDisplaySize(g_target, &changed);
+            trace.SetStatus((DWORD)status);
+            if (g_guardDeviceForm && !PanelManager::SetOEMDeviceForm()) {
+                LogDebug(L"BootService: Failed to set OEM DeviceForm registry key.");
+            }
+            LogDebug(L"BootService: Override %u x %u mm applied %llu ms after boot (NTSTATUS 0x%X, changed: %d).",
+                g_target.WidthMm, g_target.HeightMm, GetTickCount64(), status, changed);
+        }
+        ULONGLONG applyTime = 0;
+        GetSystemTimeAsFileTime(reinterpret_cast<FILETIME*>(&applyTime));
+
+        ReportStatus(SERVICE_RUNNING);
+        Trace::Milestone(L"BootService", L"Running", 0);
+
+        // DWM normally starts with the first session; the first session notification is the cue to look for it.
+        bool dwmReported = !hWatchMutex || ReportDwmLead(applyTime);
+        if (!dwmReported) LogDebug(L"BootService: No DWM yet. Waiting for the first session to report the lead.");
+
+        {
+            PanelManager::DeviceFormGuard deviceFormGuard;
+            PanelManager::DisplaySizeWatchdog watchdog;
+            Power::Monitor power;
+            HANDLE waitHandles[3] = { g_hStopEvent, g_hSessionChanged, NULL };
+            DWORD waitCount = 2;
+
+            // Watchdog subscription: the display stack's own first publish of the panel size is handled the
+            // moment it lands, instead of by polling after a delay.
+            if (hWatchMutex) {
+                if (g_guardDeviceForm && !deviceFormGuard.Start()) LogDebug(L"BootService: DeviceForm guard unavailable.");
+                NTSTATUS status = watchdog.Start(g_target);
+                if (status != 0) LogDebug(L"BootService: Watchdog unavailable (NTSTATUS 0x%X).", status);
+                if (power.Start()) waitHandles[waitCount++] = power.WakeEvent();
+            }
+
+            for (;;) {
+                DWORD waitResult = WaitForMultipleObjects(waitCount, waitHandles, FALSE, INFINITE);
+                if (waitResult == WAIT_OBJECT_0 + 1) {
+                    if (!dwmReported) dwmReported = ReportDwmLead(applyTime);
+                    continue;
+                }
+                if (waitResult == WAIT_OBJECT_0 + 2) {
+                    bool changed = false;
+                    NTSTATUS applyStatus = PanelManager::ApplyDisplaySize(g_target, &changed);
+                    bool restored = false;
+                    if (g_guardDeviceForm) PanelManager::SetOEMDeviceForm(&restored);
+                    LogDebug(L"BootService: Wake. Reasserted display size (NTSTATUS 0x%X, changed: %d, DeviceForm restored: %d).",
+                        applyStatus, changed, restored);
+                    continue;
+                }
+                break;
+            }
+            LogDebug(L"BootService: Stopping after %lu rewrites and %lu DeviceForm restores.",
+                watchdog.RewriteCount(), deviceFormGuard.RestoreCount());
+        }
+
+        if (hWatchMutex) {
+            ReleaseMutex(hWatchMutex);
+            CloseHandle(hWatchMutex);
+        }
+    }
+
+    void WINAPI ServiceMain(DWORD argc, LPWSTR* argv) {
+        UNREFERENCED_PARAMETER(argc);
+        UNREFERENCED_PARAMETER(argv);
+
+        g_hServiceStatus = RegisterServiceCtrlHandlerExW(SERVICE_NAME, ControlHandler, NULL);
+        if (!g_hServiceStatus) {
+            LogDebug(L"BootService: RegisterServiceCtrlHandlerExW failed (Error: %d).", GetLastError());
+            return;
+        }
+        ReportStatus(SERVICE_START_PENDING, NO_ERROR, START_WAIT_HINT_MS);
+
+        g_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        g_hSessionChanged = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!g_hStopEvent || !g_hSessionChanged) {
+            DWORD dwErr = GetLastError();
+            LogDebug(L"BootService: CreateEventW failed (Error: %d).", dwErr);
+            ReportStatus(SERVICE_STOPPED, dwErr);
+            return;
+        }
+
+        RunService();
+
+        CloseHandle(g_hSessionChanged);
+        CloseHandle(g_hStopEvent);
+        g_hSessionChanged = g_hStopEvent = NULL;
+        ReportStatus(SERVICE_STOPPED);
+    }
+
+    DWORD Run(const PanelManager::Dimensions& target, bool guardDeviceForm) {
+        g_target = target;
+        g_guardDeviceForm = guardDeviceForm;
+
+        SERVICE_TABLE_ENTRYW table[] = {
+            { const_cast<LPWSTR>(SERVICE_NAME), ServiceMain },
+            { nullptr, nullptr }
+        };
+        if (!StartServiceCtrlDispatcherW(table)) return GetLastError();
+        return NO_ERROR;
+    }
+
+    DWORD Install(const PanelManager::Dimensions& target, bool guardDeviceForm) {
+        wchar_t imagePath[MAX_PATH];
+        GetModuleFileNameW(NULL, imagePath, MAX_PATH);
+        wchar_t commandLine[MAX_PATH + 64];
+        swprintf_s(commandLine, L"\"%s\" bootservice %u %u%s", imagePath, target.WidthMm, target.HeightMm, guardDeviceForm ? L" reg" : L"");
+
+        SC_HANDLE hManager = OpenSCManagerW(NULL, NULL, SC_MANAGER_CONNECT | SC_MANAGER_CREATE_SERVICE);
+        if (!hManager) return GetLastError();
+
+        DWORD result = NO_ERROR;
+        SC_HANDLE hService = CreateServiceW(hManager, SERVICE_NAME, SERVICE_DISPLAY_NAME,
+            SERVICE_CHANGE_CONFIG | SERVICE_START | SERVICE_QUERY_STATUS, SERVICE_WIN32_OWN_PROCESS, SERVICE_AUTO_START,
+            SERVICE_ERROR_IGNORE, commandLine, SERVICE_LOAD_ORDER_GROUP, NULL, NULL, NULL, NULL);
+        if (!hService && GetLastError() == ERROR_SERVICE_EXISTS) {
+            // Reinstall with new dimensions: update the existing registration in place.
+            hService = OpenServiceW(hManager, SERVICE_NAME, SERVICE_CHANGE_CONFIG | SERVICE_START | SERVICE_QUERY_STATUS);
+            if (hService && !ChangeServiceConfigW(hService, SERVICE_WIN32_OWN_PROCESS, SERVICE_AUTO_START, SERVICE_ERROR_IGNORE,
+                commandLine, SERVICE_LOAD_ORDER_GROUP, NULL, NULL, NULL, NULL, SERVICE_DISPLAY_NAME)) {
+                result = GetLastError();
+            }
+        }
+        if (!hService) {
+            result = GetLastError();
+            CloseServiceHandle(hManager);
+            return result;
+        }
+
+        if (result == NO_ERROR) {
+            SERVICE_DESCRIPTIONW description = { const_cast<LPWSTR>(SERVICE_DESCRIPTION) };
+            ChangeServiceConfig2W(hService, SERVICE_CONFIG_DESCRIPTION, &description);
+            // A delayed auto-start would defeat the purpose.
+            SERVICE_DELAYED_AUTO_START_INFO delayed = { FALSE };
+            ChangeServiceConfig2W(hService, SERVICE_CONFIG_DELAYED_AUTO_START_INFO, &delayed);
+
+            // A running instance keeps its old dimensions until the next boot.
+            if (!StartServiceW(hService, 0, NULL) && GetLastError() != ERROR_SERVICE_ALREADY_RUNNING) {
+                result = GetLastError();
+            }
+        }
+
+        CloseServiceHandle(hService);
+        CloseServiceHandle(hManager);
+        return result;
+    }
+
+    DWORD Uninstall() {
+        SC_HANDLE hManager = OpenSCManagerW(NULL, NULL, SC_MANAGER_CONNECT);
+        if (!hManager) return GetLastError();
+
+        SC_HANDLE hService = OpenServiceW(hManager, SERVICE_NAME, SERVICE_STOP | SERVICE_QUERY_STATUS | DELETE);
+        if (!hService) {
+            DWORD dwErr = GetLastError();
+            CloseServiceHandle(hManager);
+            return dwErr;
+        }
+
+        SERVICE_STATUS status = {};
+        if (ControlService(hService, SERVICE_CONTROL_STOP, &status)) {
+            ULONGLONG deadline = GetTickCount64() + STOP_TIMEOUT_MS;
+            while (status.dwCurrentState != SERVICE_STOPPED && GetTickCount64() < deadline) {
+                Sleep(100);
+                if (!QueryServiceStatus(hService, &status)) break;
+            }
+        }
+
+        DWORD result = DeleteService(hService) ? NO_ERROR : GetLastError();
+        CloseServiceHandle(hService);
+        CloseServiceHandle(hManager);
+        return result;
+    }
+}
\ No newline at end of file
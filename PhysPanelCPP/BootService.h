@@ -0,0 +1,36 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+#include "PanelManager.h"
+
+// Early-boot panel override: an auto-start Win32 service in an early load-order group that publishes
+// the WNF override before it reports running, then stays resident like watch mode. A boot-trigger task
+// only runs once the task scheduler gets to it, usually after DWM and the shell have read the panel size.
+namespace BootService {
+
+    constexpr auto SERVICE_NAME = L"XfestPanelBoot";
+
+    // Entered when the SCM starts the service. Returns ERROR_FAILED_SERVICE_CONTROLLER_CONNECT when run
+    // from a console instead.
+    DWORD Run(const PanelManager::Dimensions& target, bool guardDeviceForm);
+
+    // Creates (or reconfigures) and starts the service. Requires administrator rights.
+    DWORD Install(const PanelManager::Dimensions& target, bool guardDeviceForm);
+
+    DWORD Uninstall();
+}
\ No newline at end of file
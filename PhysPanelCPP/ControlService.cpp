@@ -0,0 +1,383 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "ControlService.h"
+#include "PanelManager.h"
+#include "TouchManager.h"
+#include "Output.h"
+#include "Utils.h"
+#include "Trace.h"
+#include <sddl.h>
+
+namespace ControlService {
+
+    constexpr auto CONTROL_PIPE_NAME = L"\\\\.\\pipe\\XFEST_TouchSvc_Control";
+    constexpr auto CONTROL_PIPE_SDDL = L"D:P(A;;GA;;;SY)(A;;GA;;;BA)";
+    const DWORD CONTROL_BUFFER_CHARS = 512;
+    const DWORD CLIENT_IDLE_TIMEOUT_MS = 5000;
+    constexpr auto DRIVER_SERVICE_NAME = L"PhysPanelDrv";
+    const DWORD DRIVER_NOTIFY_MASK = SERVICE_NOTIFY_STOPPED | SERVICE_NOTIFY_START_PENDING | SERVICE_NOTIFY_STOP_PENDING |
+        SERVICE_NOTIFY_RUNNING | SERVICE_NOTIFY_DELETE_PENDING;
+
+    bool IsSignaled(HANDLE hEvent) {
+        return WaitForSingleObject(hEvent, 0) == WAIT_OBJECT_0;
+    }
+
+    void StatusCache::Start() {
+        m_hPanelChanged = CreateEventW(NULL, FALSE, FALSE, NULL);
+        m_panelWatched = m_hPanelChanged && m_panelNotifier.Start(m_hPanelChanged) == 0;
+
+        m_hRegistryChanged = CreateEventW(NULL, FALSE, FALSE, NULL);
+        ArmRegistryNotification();
+
+        if (!m_panelWatched || !m_registryWatched) {
+            LogDebug(L"StatusCache: Change notifications unavailable (panel: %d, registry: %d). Falling back to re-reads.",
+                m_panelWatched, m_registryWatched);
+        }
+    }
+
+    void StatusCache::Stop() {
+        m_panelNotifier.Stop();
+        m_panelWatched = false;
+        m_registryWatched = false;
+        m_driverWatched = false;
+
+        if (m_hOemKey) { RegCloseKey(m_hOemKey); m_hOemKey = NULL; }
+        if (m_hDriverService) { CloseServiceHandle(m_hDriverService); m_hDriverService = NULL; }
+        if (m_hScm) { CloseServiceHandle(m_hScm); m_hScm = NULL; }
+        if (m_hRegistryChanged) { CloseHandle(m_hRegistryChanged); m_hRegistryChanged = NULL; }
+        if (m_hPanelChanged) { CloseHandle(m_hPanelChanged); m_hPanelChanged = NULL; }
+    }
+
+    void CALLBACK StatusCache::OnServiceNotify(PVOID parameter) {
+        auto pNotify = static_cast<SERVICE_NOTIFYW*>(parameter);
+        static_cast<StatusCache*>(pNotify->pContext)->m_driverDirty = true;
+    }
+
+    bool StatusCache::SameSnapshot(const Snapshot& a, const Snapshot& b) {
+        return a.Panel.HasData == b.Panel.HasData && a.Panel.ChangeStamp == b.Panel.ChangeStamp &&
+            a.Panel.Dims.WidthMm == b.Panel.Dims.WidthMm && a.Panel.Dims.HeightMm == b.Panel.Dims.HeightMm &&
+            a.DeviceFormPresent == b.DeviceFormPresent && a.DeviceForm == b.DeviceForm &&
+            a.DriverInstalled == b.DriverInstalled && a.DriverState == b.DriverState &&
+            a.ActiveSession == b.ActiveSession && a.WorkerRunning == b.WorkerRunning;
+    }
+
+    void StatusCache::ArmRegistryNotification() {
+        if (!m_hOemKey && RegOpenKeyExW(HKEY_LOCAL_MACHINE, PanelManager::OEM_REGISTRY_SUBKEY, 0, KEY_NOTIFY, &m_hOemKey) != ERROR_SUCCESS) {
+            m_hOemKey = NULL;
+        }
+
+        m_registryWatched = m_hOemKey && m_hRegistryChanged &&
+            RegNotifyChangeKeyValue(m_hOemKey, FALSE, REG_NOTIFY_CHANGE_LAST_SET, m_hRegistryChanged, TRUE) == ERROR_SUCCESS;
+    }
+
+    // Reads the driver service state and registers for its next change. A notification is one-shot,
+    // so this runs again after every callback.
+    void StatusCache::ArmServiceNotification(Snapshot& next) {
+        if (m_hDriverService && (m_serviceNotify.dwNotificationTriggered & SERVICE_NOTIFY_DELETE_PENDING)) {
+            CloseServiceHandle(m_hDriverService);
+            m_hDriverService = NULL;
+        }
+
+        if (!m_hScm) m_hScm = OpenSCManagerW(NULL, NULL, SC_MANAGER_CONNECT | SC_MANAGER_ENUMERATE_SERVICE);
+        if (m_hScm && !m_hDriverService) m_hDriverService = OpenServiceW(m_hScm, DRIVER_SERVICE_NAME, SERVICE_QUERY_STATUS);
+
+        next.DriverInstalled = (m_hDriverService != NULL);
+        next.DriverState = 0;
+        m_driverWatched = false;
+        if (!m_hScm) return;
+
+        ZeroMemory(&m_serviceNotify, sizeof(m_serviceNotify));
+        m_serviceNotify.dwVersion = SERVICE_NOTIFY_STATUS_CHANGE;
+        m_serviceNotify.pfnNotifyCallback = OnServiceNotify;
+        m_serviceNotify.pContext = this;
+
+        DWORD dwErr;
+        if (m_hDriverService) {
+            SERVICE_STATUS status;
+            if (QueryServiceStatus(m_hDriverService, &status)) next.DriverState = status.dwCurrentState;
+            dwErr = NotifyServiceStatusChangeW(m_hDriverService, DRIVER_NOTIFY_MASK, &m_serviceNotify);
+            if (dwErr == ERROR_SERVICE_MARKED_FOR_DELETE) {
+                CloseServiceHandle(m_hDriverService);
+                m_hDriverService = NULL;
+            }
+        }
+        else {
+            // Not installed: wait for it to be created instead.
+            dwErr = NotifyServiceStatusChangeW(m_hScm, SERVICE_NOTIFY_CREATED, &m_serviceNotify);
+        }
+        m_driverWatched = (dwErr == ERROR_SUCCESS);
+    }
+
+    // Returns true when any source had to be re-read.
+    bool StatusCache::Refresh() {
+        Snapshot next = m_snapshot;
+        bool refreshed = false;
+
+        if (!m_primed || !m_panelWatched || IsSignaled(m_hPanelChanged)) {
+            PanelManager::QueryDisplayState(next.Panel);
+            refreshed = true;
+        }
+        if (!m_primed || !m_registryWatched || IsSignaled(m_hRegistryChanged)) {
+            // Re-arm before reading so a write in between is not missed.
+            ArmRegistryNotification();
+            next.DeviceFormPresent = PanelManager::GetOEMDeviceForm(next.DeviceForm);
+            refreshed = true;
+        }
+        if (!m_primed || !m_driverWatched || m_driverDirty) {
+            m_driverDirty = false;
+            ArmServiceNotification(next);
+            refreshed = true;
+        }
+
+        // Worker presence has no change notification; probing the session mutex is a single open.
+        next.ActiveSession = WTSGetActiveConsoleSessionId();
+        next.WorkerRunning = TouchManager::IsWorkerRunning(next.ActiveSession);
+
+        if (!m_primed || !SameSnapshot(next, m_snapshot)) {
+            ++m_version;
+        }
+        m_snapshot = next;
+        m_primed = true;
+        return refreshed;
+    }
+
+    void StatusCache::Describe(Output::JsonObject& json) {
+        bool refreshed = Refresh();
+        const Snapshot& snapshot = m_snapshot;
+
+        Output::JsonObject panel;
+        panel.AddBool(L"hasData", snapshot.Panel.HasData).AddUInt(L"changeStamp", snapshot.Panel.ChangeStamp);
+        if (snapshot.Panel.HasData) {
+            panel.AddUInt(L"widthMm", snapshot.Panel.Dims.WidthMm).AddUInt(L"heightMm", snapshot.Panel.Dims.HeightMm);
+        }
+
+        Output::JsonObject deviceForm;
+        deviceForm.AddBool(L"present", snapshot.DeviceFormPresent);
+        if (snapshot.DeviceFormPresent) deviceForm.AddUInt(L"value", snapshot.DeviceForm);
+
+        json.AddUInt(L"version", m_version)
+            .AddBool(L"cached", !refreshed)
+            .AddObject(L"panel", panel)
+            .AddObject(L"oemDeviceForm", deviceForm)
+            .AddObject(L"driver", Output::JsonObject().AddBool(L"installed", snapshot.DriverInstalled).AddUInt(L"state", snapshot.DriverState))
+            .AddUInt(L"activeSession", snapshot.ActiveSession)
+            .AddBool(L"workerRunning", snapshot.WorkerRunning);
+    }
+
+    Server::~Server() {
+        Stop();
+    }
+
+    bool Server::Start() {
+        PSECURITY_DESCRIPTOR pSd = nullptr;
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(CONTROL_PIPE_SDDL, SDDL_REVISION_1, &pSd, NULL)) {
+            LogDebug(L"ControlService: Invalid pipe SDDL (Error: %d).", GetLastError());
+            return false;
+        }
+
+        SECURITY_ATTRIBUTES sa = { sizeof(sa), pSd, FALSE };
+        // FIRST_PIPE_INSTANCE: refuse to start if another process already squats on the name.
+        m_hPipe = CreateNamedPipeW(
+            CONTROL_PIPE_NAME,
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            1,
+            CONTROL_BUFFER_CHARS * sizeof(wchar_t),
+            CONTROL_BUFFER_CHARS * sizeof(wchar_t),
+            0,
+            &sa);
+        LocalFree(pSd);
+
+        if (m_hPipe == INVALID_HANDLE_VALUE) {
+            LogDebug(L"ControlService: CreateNamedPipeW failed (Error: %d).", GetLastError());
+            return false;
+        }
+
+        m_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        m_hThread = m_hStopEvent ? CreateThread(NULL, 0, ThreadProc, this, 0, NULL) : NULL;
+        if (!m_hThread) {
+            LogDebug(L"ControlService: Failed to start server thread (Error: %d).", GetLastError());
+            Stop();
+            return false;
+        }
+
+        LogDebug(L"ControlService: Listening on %s", CONTROL_PIPE_NAME);
+        return true;
+    }
+
+    void Server::Stop() {
+        if (m_hThread) {
+            SetEvent(m_hStopEvent);
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            m_hThread = NULL;
+        }
+        if (m_hStopEvent) {
+            CloseHandle(m_hStopEvent);
+            m_hStopEvent = NULL;
+        }
+        if (m_hPipe != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_hPipe);
+            m_hPipe = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    DWORD WINAPI Server::ThreadProc(LPVOID param) {
+        static_cast<Server*>(param)->Serve();
+        return 0;
+    }
+
+    // Completes an overlapped pipe operation, giving up on stop or timeout. The wait is alertable
+    // so SCM status callbacks for the cache are delivered while the thread is idle.
+    bool Server::WaitForIo(OVERLAPPED& ov, DWORD timeoutMs, DWORD& bytes) {
+        HANDLE handles[] = { ov.hEvent, m_hStopEvent };
+        DWORD waitResult;
+        do {
+            waitResult = WaitForMultipleObjectsEx(2, handles, FALSE, timeoutMs, TRUE);
+        } while (waitResult == WAIT_IO_COMPLETION);
+
+        if (waitResult != WAIT_OBJECT_0) {
+            CancelIoEx(m_hPipe, &ov);
+            GetOverlappedResult(m_hPipe, &ov, &bytes, TRUE);
+            return false;
+        }
+        return GetOverlappedResult(m_hPipe, &ov, &bytes, FALSE) != FALSE;
+    }
+
+    void Server::Serve() {
+        OVERLAPPED ov = { 0 };
+        ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (!ov.hEvent) return;
+
+        m_cache.Start();
+
+        // Requests are microsecond-scale, so clients are served one at a time on this thread.
+        while (WaitForSingleObject(m_hStopEvent, 0) != WAIT_OBJECT_0) {
+            ResetEvent(ov.hEvent);
+            bool connected = ConnectNamedPipe(m_hPipe, &ov) != FALSE;
+            if (!connected) {
+                DWORD dwErr = GetLastError();
+                DWORD bytes = 0;
+                if (dwErr == ERROR_PIPE_CONNECTED) {
+                    connected = true;
+                }
+                else if (dwErr == ERROR_IO_PENDING) {
+                    connected = WaitForIo(ov, INFINITE, bytes);
+                }
+                else {
+                    LogDebug(L"ControlService: ConnectNamedPipe failed (Error: %d).", dwErr);
+                    if (WaitForSingleObjectEx(m_hStopEvent, 1000, TRUE) == WAIT_OBJECT_0) break;
+                }
+            }
+
+            if (connected) {
+                ServeClient(ov);
+            }
+            DisconnectNamedPipe(m_hPipe);
+        }
+
+        m_cache.Stop();
+        CloseHandle(ov.hEvent);
+    }
+
+    void Server::ServeClient(OVERLAPPED& ov) {
+        wchar_t request[CONTROL_BUFFER_CHARS];
+
+        while (true) {
+            DWORD bytes = 0;
+            ResetEvent(ov.hEvent);
+            if (!ReadFile(m_hPipe, request, sizeof(request) - sizeof(wchar_t), NULL, &ov) && GetLastError() != ERROR_IO_PENDING) {
+                return;
+            }
+            if (!WaitForIo(ov, CLIENT_IDLE_TIMEOUT_MS, bytes) || bytes == 0) {
+                return;
+            }
+            request[bytes / sizeof(wchar_t)] = L'\0';
+
+            std::wstring reply = Execute(request);
+
+            ResetEvent(ov.hEvent);
+            if (!WriteFile(m_hPipe, reply.c_str(), (DWORD)(reply.size() * sizeof(wchar_t)), NULL, &ov) && GetLastError() != ERROR_IO_PENDING) {
+                return;
+            }
+            if (!WaitForIo(ov, CLIENT_IDLE_TIMEOUT_MS, bytes)) {
+                return;
+            }
+        }
+    }
+
+    std::wstring Server::Execute(wchar_t* request) {
+        LONGLONG start = Trace::Timestamp();
+
+        wchar_t* context = nullptr;
+        const wchar_t* delimiters = L" \t\r\n";
+        wchar_t* command = wcstok_s(request, delimiters, &context);
+
+        Output::JsonObject json;
+        json.AddString(L"command", command ? command : L"");
+
+        if (command && _wcsicmp(command, L"get") == 0) {
+            PanelManager::PanelState state;
+            NTSTATUS status = PanelManager::QueryDisplayState(state);
+            json.AddBool(L"success", status == 0 && state.HasData)
+                .AddNtStatus(L"ntstatus", status)
+                .AddBool(L"hasData", state.HasData)
+                .AddUInt(L"changeStamp", state.ChangeStamp);
+            if (state.HasData) {
+                json.AddUInt(L"widthMm", state.Dims.WidthMm).AddUInt(L"heightMm", state.Dims.HeightMm);
+            }
+        }
+        else if (command && _wcsicmp(command, L"set") == 0) {
+            wchar_t* widthArg = wcstok_s(nullptr, delimiters, &context);
+            wchar_t* heightArg = wcstok_s(nullptr, delimiters, &context);
+            PanelManager::Dimensions target;
+
+            if (!PanelManager::ParseDimensions(widthArg, heightArg, target) || wcstok_s(nullptr, delimiters, &context)) {
+                json.AddBool(L"success", false).AddString(L"error", L"Arguments must be positive integers.");
+            }
+            else {
+                bool changed = false;
+                NTSTATUS status = PanelManager::ApplyDisplaySize(target, &changed);
+                json.AddBool(L"success", status == 0)
+                    .AddNtStatus(L"ntstatus", status)
+                    .AddBool(L"changed", changed)
+                    .AddUInt(L"widthMm", target.WidthMm)
+                    .AddUInt(L"heightMm", target.HeightMm);
+            }
+        }
+        else if (command && _wcsicmp(command, L"reg") == 0) {
+            bool changed = false;
+            bool success = PanelManager::SetOEMDeviceForm(&changed);
+            json.AddBool(L"success", success).AddBool(L"changed", changed);
+        }
+        else if (command && _wcsicmp(command, L"status") == 0) {
+            json.AddBool(L"success", true);
+            m_cache.Describe(json);
+            json.AddUInt(L"masterPid", GetCurrentProcessId());
+        }
+        else if (command && _wcsicmp(command, L"restart") == 0) {
+            json.AddBool(L"success", TouchManager::RestartWorkers(WTSGetActiveConsoleSessionId()));
+        }
+        else {
+            json.AddBool(L"success", false).AddString(L"error", L"Unknown command.");
+        }
+
+        LogDebug(L"ControlService: Handled '%s'.", command ? command : L"");
+        return json.AddInt(L"elapsedUs", Trace::ElapsedUs(start)).ToString();
+    }
+}
\ No newline at end of file
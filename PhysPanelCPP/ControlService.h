@@ -0,0 +1,108 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+#include "PanelManager.h"
+#include "Output.h"
+#include <string>
+
+// Local control API hosted by the session 0 touch service master (SYSTEM).
+// Clients connect to \\.\pipe\XFEST_TouchSvc_Control and send one command per message:
+//   get | set <w> <h> | reg | status | restart
+// Each reply is a single JSON object in the same shape as the CLI's --json output.
+// The pipe DACL admits only SYSTEM and elevated Administrators; remote clients are rejected.
+namespace ControlService {
+
+    // Versioned status snapshot for "status". Each source is re-read only after its change
+    // notification fires (WNF publish, OEM key write, SCM state change), so repeated refreshes
+    // from the GUI are served from memory. The version increments whenever a value changes.
+    // Must live on the serving thread: registry notifications are bound to it and SCM callbacks
+    // arrive as APCs during its alertable waits.
+    class StatusCache {
+    public:
+        StatusCache() = default;
+        ~StatusCache() { Stop(); }
+
+        StatusCache(const StatusCache&) = delete;
+        StatusCache& operator=(const StatusCache&) = delete;
+
+        void Start();
+
+        void Stop();
+
+        void Describe(Output::JsonObject& json);
+
+    private:
+        struct Snapshot {
+            PanelManager::PanelState Panel = {};
+            bool DeviceFormPresent = false;
+            DWORD DeviceForm = 0;
+            bool DriverInstalled = false;
+            DWORD DriverState = 0;
+            DWORD ActiveSession = 0;
+            bool WorkerRunning = false;
+        };
+
+        static void CALLBACK OnServiceNotify(PVOID parameter);
+
+        static bool SameSnapshot(const Snapshot& a, const Snapshot& b);
+
+        bool Refresh();
+        void ArmRegistryNotification();
+        void ArmServiceNotification(Snapshot& next);
+
+        Snapshot m_snapshot;
+        ULONGLONG m_version = 0;
+        bool m_primed = false;
+
+        PanelManager::DisplaySizeChangeNotifier m_panelNotifier;
+        HANDLE m_hPanelChanged = NULL;
+        bool m_panelWatched = false;
+
+        HKEY m_hOemKey = NULL;
+        HANDLE m_hRegistryChanged = NULL;
+        bool m_registryWatched = false;
+
+        SC_HANDLE m_hScm = NULL;
+        SC_HANDLE m_hDriverService = NULL;
+        SERVICE_NOTIFYW m_serviceNotify = {};
+        bool m_driverWatched = false;
+        volatile bool m_driverDirty = false;
+    };
+
+    class Server {
+    public:
+        ~Server();
+
+        bool Start();
+
+        void Stop();
+
+    private:
+        static DWORD WINAPI ThreadProc(LPVOID param);
+
+        void Serve();
+        void ServeClient(OVERLAPPED& ov);
+        bool WaitForIo(OVERLAPPED& ov, DWORD timeoutMs, DWORD& bytes);
+        std::wstring Execute(wchar_t* request);
+
+        StatusCache m_cache;
+        HANDLE m_hPipe = INVALID_HANDLE_VALUE;
+        HANDLE m_hStopEvent = NULL;
+        HANDLE m_hThread = NULL;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "FeatureManager.h"
+#include "Utils.h"
+
+typedef ULONGLONG RTL_FEATURE_CHANGE_STAMP, * PRTL_FEATURE_CHANGE_STAMP;
+
+typedef struct _RTL_FEATURE_CONFIGURATION {
+    ULONG FeatureId;
+    union {
+        ULONG Flags;
+        struct {
+            ULONG Priority : 4;
+            ULONG EnabledState : 2;
+            ULONG IsWexpConfiguration : 1;
+            ULONG HasSubscriptions : 1;
+            ULONG Variant : 6;
+            ULONG VariantPayloadKind : 2;
+            ULONG Reserved : 16;
+        };
+    };
+    ULONG VariantPayload;
+} RTL_FEATURE_CONFIGURATION, * PRTL_FEATURE_CONFIGURATION;
+
+typedef struct _RTL_FEATURE_CONFIGURATION_UPDATE {
+    ULONG FeatureId;
+    ULONG Priority;
+    ULONG EnabledState;
+    ULONG EnabledStateOptions;
+    UCHAR Variant;
+    UCHAR Reserved[3];
+    ULONG VariantPayloadKind;
+    ULONG VariantPayload;
+    ULONG Operation;
+} RTL_FEATURE_CONFIGURATION_UPDATE, * PRTL_FEATURE_CONFIGURATION_UPDATE;
+
+typedef NTSTATUS(NTAPI* PRtlQueryFeatureConfiguration)(
+    _In_ ULONG FeatureId,
+    _In_ ULONG ConfigurationType,
+    _Inout_ PRTL_FEATURE_CHANGE_STAMP ChangeStamp,
+    _Out_ PRTL_FEATURE_CONFIGURATION FeatureConfiguration);
+
+typedef NTSTATUS(NTAPI* PRtlSetFeatureConfigurations)(
+    _Inout_opt_ PRTL_FEATURE_CHANGE_STAMP PreviousChangeStamp,
+    _In_ ULONG ConfigurationType,
+    _In_reads_(ConfigurationUpdateCount) PRTL_FEATURE_CONFIGURATION_UPDATE ConfigurationUpdates,
+    _In_ SIZE_T ConfigurationUpdateCount);
+
+namespace FeatureManager {
+
+    const NTSTATUS FEATURE_STATUS_NOT_FOUND = (NTSTATUS)0xC0000225L; // STATUS_NOT_FOUND
+
+    // RTL_FEATURE_CONFIGURATION_OPERATION flags.
+    const ULONG OPERATION_FEATURE_STATE = 1;
+    const ULONG OPERATION_VARIANT_STATE = 2;
+    const ULONG OPERATION_RESET_STATE = 4;
+
+    // Resolved once; ntdll is always loaded, so the module handle never goes stale.
+    struct RtlFeatureApi {
+        PRtlQueryFeatureConfiguration RtlQueryFeatureConfiguration;
+        PRtlSetFeatureConfigurations RtlSetFeatureConfigurations;
+    };
+
+    const RtlFeatureApi& GetApi() {
+        static const RtlFeatureApi api = [] {
+            RtlFeatureApi resolved = {};
+            HMODULE hNtdll = GetModuleHandleW(L"ntdll.dll");
+            if (hNtdll) {
+                resolved.RtlQueryFeatureConfiguration = (PRtlQueryFeatureConfiguration)GetProcAddress(hNtdll, "RtlQueryFeatureConfiguration");
+                resolved.RtlSetFeatureConfigurations = (PRtlSetFeatureConfigurations)GetProcAddress(hNtdll, "RtlSetFeatureConfigurations");
+            }
+            return resolved;
+        }();
+        return api;
+    }
+
+    NTSTATUS Query(const std::vector<ULONG>& ids, ConfigurationType type, std::vector<FeatureState>& states, ULONGLONG* changeStamp) {
+        states.clear();
+        const RtlFeatureApi& api = GetApi();
+        if (!api.RtlQueryFeatureConfiguration) {
+            LogDebug(L"Features: RtlQueryFeatureConfiguration unavailable.");
+            return FEATURE_STATUS_NOT_FOUND;
+        }
+
+        states.reserve(ids.size());
+        RTL_FEATURE_CHANGE_STAMP stamp = 0;
+        for (ULONG id : ids) {
+            RTL_FEATURE_CONFIGURATION config = {};
+            NTSTATUS status = api.RtlQueryFeatureConfiguration(id, (ULONG)type, &stamp, &config);
+
+            FeatureState state = { id, false, EnabledState::Default, 0, 0 };
+            if (status >= 0) {
+                state.Found = true;
+                state.State = (EnabledState)config.EnabledState;
+                state.Priority = config.Priority;
+                state.Variant = config.Variant;
+            }
+            else if (status != FEATURE_STATUS_NOT_FOUND) {
+                LogDebug(L"Features: Query for %lu failed (NTSTATUS: 0x%X).", id, status);
+                return status;
+            }
+            states.push_back(state);
+        }
+
+        if (changeStamp) *changeStamp = stamp;
+        return 0;
+    }
+
+    NTSTATUS Apply(const std::vector<ULONG>& ids, Action action, ConfigurationType type) {
+        const RtlFeatureApi& api = GetApi();
+        if (!api.RtlSetFeatureConfigurations) {
+            LogDebug(L"Features: RtlSetFeatureConfigurations unavailable.");
+            return FEATURE_STATUS_NOT_FOUND;
+        }
+        if (ids.empty()) return 0;
+
+        // Same shape the GUI builds through ViVe: enable also pins variant 0, reset drops the user override.
+        std::vector<RTL_FEATURE_CONFIGURATION_UPDATE> updates(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            RTL_FEATURE_CONFIGURATION_UPDATE& update = updates[i];
+            update.FeatureId = ids[i];
+            update.Priority = PRIORITY_USER;
+            switch (action) {
+            case Action::Enable:
+                update.EnabledState = (ULONG)EnabledState::Enabled;
+                update.Operation = OPERATION_FEATURE_STATE | OPERATION_VARIANT_STATE;
+                break;
+            case Action::Disable:
+                update.EnabledState = (ULONG)EnabledState::Disabled;
+                update.Operation = OPERATION_FEATURE_STATE;
+                break;
+            case Action::Reset:
+                update.EnabledState = (ULONG)EnabledState::Default;
+                update.Operation = OPERATION_RESET_STATE;
+                break;
+            }
+        }
+
+        NTSTATUS status = api.RtlSetFeatureConfigurations(nullptr, (ULONG)type, updates.data(), updates.size());
+        if (status < 0) {
+            LogDebug(L"Features: RtlSetFeatureConfigurations (type %lu, %zu IDs) failed (NTSTATUS: 0x%X).", (ULONG)type, ids.size(), status);
+        }
+        return status;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+#include <vector>
+
+// Batched access to the ntdll feature configuration store (the same RTL APIs ViVe wraps), so the GUI
+// can query or change its whole feature ID set with one process call instead of one interop
+// round-trip per ID and configuration type.
+namespace FeatureManager {
+
+    enum class ConfigurationType : ULONG { Runtime = 0, Boot = 1 };
+
+    enum class EnabledState : ULONG { Default = 0, Disabled = 1, Enabled = 2 };
+
+    enum class Action { Enable, Disable, Reset };
+
+    // RTL_FEATURE_CONFIGURATION_PRIORITY User, the level the GUI writes at.
+    const ULONG PRIORITY_USER = 8;
+
+    struct FeatureState {
+        ULONG FeatureId;
+        bool Found;
+        EnabledState State;
+        ULONG Priority;
+        ULONG Variant;
+    };
+
+    // Fills 'states' in the order of 'ids'. IDs without a configuration are reported as not found
+    // rather than failing the whole query. Returns STATUS_NOT_FOUND when ntdll lacks the API.
+    NTSTATUS Query(const std::vector<ULONG>& ids, ConfigurationType type, std::vector<FeatureState>& states, ULONGLONG* changeStamp = nullptr);
+
+    // Writes every ID in one RtlSetFeatureConfigurations call at user priority. Requires administrator rights.
+    NTSTATUS Apply(const std::vector<ULONG>& ids, Action action, ConfigurationType type);
+}
\ No newline at end of file
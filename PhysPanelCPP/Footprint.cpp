@@ -0,0 +1,105 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "Footprint.h"
+#include "Utils.h"
+#include <psapi.h>
+
+namespace Footprint {
+
+    // Long enough for every desktop of a worker (or every session of the master) to finish coming up.
+    const LONGLONG SETTLE_DELAY_MS = 3000;
+    const DWORD REFRESH_INTERVAL_MS = 5 * 60 * 1000;
+    const DWORD REFRESH_WINDOW_MS = 60 * 1000;
+
+    bool Query(Usage& usage) {
+        PROCESS_MEMORY_COUNTERS_EX counters = { sizeof(counters) };
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) {
+            return false;
+        }
+        usage.PrivateBytes = counters.PrivateUsage;
+        usage.WorkingSetBytes = counters.WorkingSetSize;
+        return true;
+    }
+
+    void TrimWorkingSet() {
+        if (!SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1)) {
+            LogDebug(L"Footprint: Working set trim failed (Error: %d).", GetLastError());
+        }
+    }
+
+    bool Trimmer::Start(PublishCallback publish) {
+        if (m_settleTimer) return true;
+
+        m_publish = publish;
+        m_settleTimer = CreateThreadpoolTimer(OnSettled, this, NULL);
+        m_refreshTimer = CreateThreadpoolTimer(OnRefresh, this, NULL);
+        if (!m_settleTimer || !m_refreshTimer) {
+            LogDebug(L"Footprint: CreateThreadpoolTimer failed (Error: %d).", GetLastError());
+            Stop();
+            return false;
+        }
+        return true;
+    }
+
+    void Trimmer::Stop() {
+        PTP_TIMER timers[] = { m_settleTimer, m_refreshTimer };
+        for (PTP_TIMER timer : timers) {
+            if (!timer) continue;
+            SetThreadpoolTimer(timer, NULL, 0, 0);
+            WaitForThreadpoolTimerCallbacks(timer, TRUE);
+            CloseThreadpoolTimer(timer);
+        }
+        m_settleTimer = nullptr;
+        m_refreshTimer = nullptr;
+    }
+
+    void Trimmer::NotifyReady() {
+        if (!m_settleTimer) return;
+
+        // Re-arming restarts the delay, so a burst of ready notifications trims once.
+        ULARGE_INTEGER dueTime;
+        dueTime.QuadPart = (ULONGLONG)(-SETTLE_DELAY_MS * 10000);
+        FILETIME ft = { dueTime.LowPart, dueTime.HighPart };
+        SetThreadpoolTimer(m_settleTimer, &ft, 0, 0);
+    }
+
+    VOID CALLBACK Trimmer::OnSettled(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER) {
+        auto pTrimmer = static_cast<Trimmer*>(context);
+
+        Usage before = {};
+        Query(before);
+        TrimWorkingSet();
+        pTrimmer->Publish();
+        LogDebug(L"Footprint: Trimmed working set from %llu KB (private %llu KB).", before.WorkingSetBytes / 1024, before.PrivateBytes / 1024);
+
+        // Private bytes drift slowly once idle; a loose window lets the refresh coalesce with other timers.
+        ULARGE_INTEGER dueTime;
+        dueTime.QuadPart = (ULONGLONG)(-(LONGLONG)REFRESH_INTERVAL_MS * 10000);
+        FILETIME ft = { dueTime.LowPart, dueTime.HighPart };
+        SetThreadpoolTimer(pTrimmer->m_refreshTimer, &ft, REFRESH_INTERVAL_MS, REFRESH_WINDOW_MS);
+    }
+
+    VOID CALLBACK Trimmer::OnRefresh(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER) {
+        static_cast<Trimmer*>(context)->Publish();
+    }
+
+    void Trimmer::Publish() {
+        Usage usage = {};
+        if (m_publish && Query(usage)) m_publish(usage);
+    }
+}
\ No newline at end of file
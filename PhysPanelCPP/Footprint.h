@@ -0,0 +1,66 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+
+// Idle memory footprint of the resident service processes.
+namespace Footprint {
+
+    struct Usage {
+        ULONGLONG PrivateBytes;
+        ULONGLONG WorkingSetBytes;
+    };
+
+    // Current process. Returns false when the counters cannot be read.
+    bool Query(Usage& usage);
+
+    // Empties the working set; pages fault back in only when touched again.
+    void TrimWorkingSet();
+
+    typedef void (*PublishCallback)(const Usage& usage);
+
+    // Trims the working set once the process settles into its ready state and publishes its footprint
+    // then and at a slow interval afterwards. Both run on threadpool timers, so none of the caller's
+    // threads wake up for them.
+    class Trimmer {
+    public:
+        Trimmer() = default;
+        ~Trimmer() { Stop(); }
+
+        Trimmer(const Trimmer&) = delete;
+        Trimmer& operator=(const Trimmer&) = delete;
+
+        bool Start(PublishCallback publish);
+
+        void Stop();
+
+        // Call whenever the process reaches its ready state again. Calls within the settle delay
+        // coalesce into one trim.
+        void NotifyReady();
+
+    private:
+        static VOID CALLBACK OnSettled(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer);
+
+        static VOID CALLBACK OnRefresh(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer);
+
+        void Publish();
+
+        PublishCallback m_publish = nullptr;
+        PTP_TIMER m_settleTimer = nullptr;
+        PTP_TIMER m_refreshTimer = nullptr;
+    };
+}
\ No newline at end of file
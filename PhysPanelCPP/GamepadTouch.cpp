@@ -0,0 +1,365 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "GamepadTouch.h"
+#include "Utils.h"
+#include "Trace.h"
+#include <Xinput.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+namespace GamepadTouch {
+
+    typedef DWORD(WINAPI* PXInputGetState)(DWORD, XINPUT_STATE*);
+
+    // Loaded at runtime so the worker does not depend on XInput unless the pipeline is enabled.
+    const LPCWSTR XINPUT_DLLS[] = { L"XInput1_4.dll", L"XInput9_1_0.dll" };
+
+    const LONGLONG FRAME_INTERVAL_US = 8000;      // ~125 Hz while a controller drives touch.
+    const LONGLONG IDLE_POLL_INTERVAL_US = 33000; // Connected but not engaged: only watching for the chord.
+    const LONGLONG RESCAN_INTERVAL_US = 1000000;  // XInputGetState on an empty slot is slow, so probe those rarely.
+    const LONGLONG STATS_INTERVAL_US = 10000000;
+    const double MAX_FRAME_SECONDS = 0.1;
+
+    const WORD ENGAGE_CHORD = XINPUT_GAMEPAD_BACK | XINPUT_GAMEPAD_START;
+    const BYTE CONTACT_TRIGGER_THRESHOLD = XINPUT_GAMEPAD_TRIGGER_THRESHOLD * 2;
+    const double FULL_SWEEP_SECONDS = 1.0; // Full deflection crosses the screen width in this long.
+    const LONG CONTACT_RADIUS = 4;
+    const UINT32 CONTACT_PRESSURE = 32000;
+
+    // Pointer 0 belongs to the readiness probe, which may re-run while the pipeline is active.
+    const UINT32 FIRST_POINTER_ID = 1;
+
+    static_assert(FIRST_POINTER_ID + MAX_CONTROLLERS * CONTACTS_PER_CONTROLLER <= MAX_CONTACTS, "Contact budget exceeded");
+
+    // Squared response past the dead zone keeps small deflections precise.
+    void MoveContact(double& position, SHORT axis, SHORT deadZone, double pixelsPerSecond, double elapsedSeconds) {
+        int magnitude = axis < 0 ? -(int)axis : (int)axis;
+        if (magnitude <= deadZone) return;
+
+        double deflection = (double)(magnitude - deadZone) / (32767 - deadZone);
+        if (deflection > 1.0) deflection = 1.0;
+        double delta = deflection * deflection * pixelsPerSecond * elapsedSeconds;
+        position += axis < 0 ? -delta : delta;
+    }
+
+    void ClampToBounds(double& x, double& y, const RECT& bounds) {
+        x = (std::max)((double)bounds.left, (std::min)(x, (double)bounds.right - 1));
+        y = (std::max)((double)bounds.top, (std::min)(y, (double)bounds.bottom - 1));
+    }
+
+    bool Pipeline::Start(const Config& config) {
+        if (m_hThread) return true;
+        if (!config.hDesktop || !config.InjectTouchInput) return false;
+        m_config = config;
+
+        for (LPCWSTR dll : XINPUT_DLLS) {
+            m_hXInput = LoadLibraryExW(dll, NULL, LOAD_LIBRARY_SEARCH_SYSTEM32);
+            if (!m_hXInput) continue;
+            m_pXInputGetState = GetProcAddress(m_hXInput, "XInputGetState");
+            if (m_pXInputGetState) break;
+            FreeLibrary(m_hXInput);
+            m_hXInput = NULL;
+        }
+        if (!m_pXInputGetState) {
+            LogDebug(L"GamepadTouch: XInput unavailable. Pipeline disabled.");
+            Stop();
+            return false;
+        }
+
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        m_qpcFrequency = frequency.QuadPart;
+
+        m_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        m_hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!m_hTimer) {
+            LogDebug(L"GamepadTouch: High-resolution timer unavailable (Error: %d). Using a standard timer.", GetLastError());
+            m_hTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+        }
+        if (!m_hStopEvent || !m_hTimer) {
+            LogDebug(L"GamepadTouch: Failed to create pipeline events (Error: %d).", GetLastError());
+            Stop();
+            return false;
+        }
+
+        m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        if (!m_hThread) {
+            LogDebug(L"GamepadTouch: CreateThread failed (Error: %d).", GetLastError());
+            Stop();
+            return false;
+        }
+        return true;
+    }
+
+    void Pipeline::Stop() {
+        if (m_hThread) {
+            SetEvent(m_hStopEvent);
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            m_hThread = NULL;
+        }
+        if (m_hTimer) { CloseHandle(m_hTimer); m_hTimer = NULL; }
+        if (m_hStopEvent) { CloseHandle(m_hStopEvent); m_hStopEvent = NULL; }
+        if (m_hXInput) { FreeLibrary(m_hXInput); m_hXInput = NULL; }
+        m_pXInputGetState = nullptr;
+    }
+
+    DWORD WINAPI Pipeline::ThreadProc(LPVOID param) {
+        static_cast<Pipeline*>(param)->Run();
+        return 0;
+    }
+
+    void Pipeline::Run() {
+        // A fresh thread owns no windows, so it can join the desktop the injection context was proven on.
+        if (!SetThreadDesktop(m_config.hDesktop)) {
+            LogDebug(L"GamepadTouch: SetThreadDesktop failed (Error: %d). Pipeline stopped.", GetLastError());
+            return;
+        }
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+        // InjectTouchInput takes physical pixels.
+        SetThreadDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
+        LogDebug(L"GamepadTouch: Input thread started. Press View+Menu on a controller to drive touch.");
+        Trace::Milestone(L"GamepadTouch", L"PipelineStarted", 0);
+
+        LONGLONG now = Trace::Timestamp();
+        LONGLONG nextTick = now;
+        LONGLONG lastSample = now;
+        LONGLONG lastRescan = now - RESCAN_INTERVAL_US * m_qpcFrequency / 1000000;
+        LONGLONG lastStats = now;
+
+        for (;;) {
+            bool paused = false;
+            if (!WaitForGates(paused)) break;
+
+            now = Trace::Timestamp();
+            if (paused) nextTick = now;
+            bool rescan = (now - lastRescan) * 1000000 / m_qpcFrequency >= RESCAN_INTERVAL_US;
+            if (rescan) {
+                UpdateBounds();
+                lastRescan = now;
+            }
+
+            double elapsedSeconds = (std::min)((double)(now - lastSample) / m_qpcFrequency, MAX_FRAME_SECONDS);
+            lastSample = now;
+            PollControllers(rescan, elapsedSeconds);
+            InjectFrame(nextTick);
+
+            if ((now - lastStats) * 1000000 / m_qpcFrequency >= STATS_INTERVAL_US) {
+                LogStats(L"interval");
+                lastStats = now;
+            }
+
+            bool anyConnected = false;
+            bool anyEngaged = false;
+            for (const auto& controller : m_controllers) {
+                anyConnected |= controller.Connected;
+                anyEngaged |= controller.Engaged;
+            }
+            LONGLONG intervalUs = anyEngaged ? FRAME_INTERVAL_US : (anyConnected ? IDLE_POLL_INTERVAL_US : RESCAN_INTERVAL_US);
+
+            // Fixed cadence against absolute deadlines; after a stall, skip the missed frames instead of bursting.
+            nextTick += intervalUs * m_qpcFrequency / 1000000;
+            now = Trace::Timestamp();
+            if (nextTick <= now) nextTick = now + intervalUs * m_qpcFrequency / 1000000;
+
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -((nextTick - now) * 10000000 / m_qpcFrequency);
+            if (dueTime.QuadPart == 0) dueTime.QuadPart = -1;
+            if (!SetWaitableTimer(m_hTimer, &dueTime, 0, NULL, NULL, FALSE)) {
+                LogDebug(L"GamepadTouch: SetWaitableTimer failed (Error: %d). Pipeline stopped.", GetLastError());
+                break;
+            }
+
+            HANDLE handles[] = { m_hStopEvent, m_hTimer };
+            if (WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) break;
+        }
+
+        ReleaseAllContacts(Trace::Timestamp());
+        LogStats(L"stopped");
+        LogDebug(L"GamepadTouch: Input thread stopped.");
+    }
+
+    // Lifts every contact before pausing while the display is off or the session is switched away from.
+    bool Pipeline::WaitForGates(bool& paused) {
+        paused = false;
+        HANDLE gates[] = { m_config.hDisplayOnEvent, m_config.hSessionActiveEvent };
+        for (bool closed = true; closed; ) {
+            closed = false;
+            for (HANDLE hGate : gates) {
+                if (!hGate || WaitForSingleObject(hGate, 0) == WAIT_OBJECT_0) continue;
+
+                if (!paused) {
+                    ReleaseAllContacts(Trace::Timestamp());
+                    LogDebug(L"GamepadTouch: Paused (display off or session inactive).");
+                }
+                closed = paused = true;
+                HANDLE handles[] = { m_hStopEvent, hGate };
+                if (WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) return false;
+            }
+        }
+        return true;
+    }
+
+    void Pipeline::PollControllers(bool rescan, double elapsedSeconds) {
+        auto XInputGetState = reinterpret_cast<PXInputGetState>(m_pXInputGetState);
+        double pixelsPerSecond = (m_bounds.right - m_bounds.left) / FULL_SWEEP_SECONDS;
+
+        for (DWORD index = 0; index < MAX_CONTROLLERS; ++index) {
+            Controller& controller = m_controllers[index];
+            if (!controller.Connected && !rescan) continue;
+
+            XINPUT_STATE state;
+            if (XInputGetState(index, &state) != ERROR_SUCCESS) {
+                if (controller.Connected) LogDebug(L"GamepadTouch: Controller %u disconnected.", index);
+                controller.Connected = controller.Engaged = controller.ChordHeld = false;
+                for (auto& contact : controller.Contacts) contact.Down = false;
+                continue;
+            }
+            if (!controller.Connected) {
+                LogDebug(L"GamepadTouch: Controller %u connected.", index);
+                controller.Connected = true;
+            }
+
+            const XINPUT_GAMEPAD& pad = state.Gamepad;
+            bool chord = (pad.wButtons & ENGAGE_CHORD) == ENGAGE_CHORD;
+            if (chord && !controller.ChordHeld) {
+                controller.Engaged = !controller.Engaged;
+                LogDebug(L"GamepadTouch: Controller %u %s touch.", index, controller.Engaged ? L"now drives" : L"released");
+                if (controller.Engaged) {
+                    // Start near the centre, the second contact offset so a pinch has room to close.
+                    LONG width = m_bounds.right - m_bounds.left;
+                    LONG height = m_bounds.bottom - m_bounds.top;
+                    for (DWORD c = 0; c < CONTACTS_PER_CONTROLLER; ++c) {
+                        controller.Contacts[c].X = m_bounds.left + width / 2.0 + c * width / 10.0;
+                        controller.Contacts[c].Y = m_bounds.top + height / 2.0;
+                    }
+                }
+            }
+            controller.ChordHeld = chord;
+
+            Contact& primary = controller.Contacts[0];
+            Contact& secondary = controller.Contacts[1];
+            if (!controller.Engaged) {
+                primary.Down = secondary.Down = false;
+                continue;
+            }
+
+            MoveContact(primary.X, pad.sThumbLX, XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE, pixelsPerSecond, elapsedSeconds);
+            MoveContact(primary.Y, (SHORT)-(pad.sThumbLY + 1), XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE, pixelsPerSecond, elapsedSeconds);
+            MoveContact(secondary.X, pad.sThumbRX, XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE, pixelsPerSecond, elapsedSeconds);
+            MoveContact(secondary.Y, (SHORT)-(pad.sThumbRY + 1), XINPUT_GAMEPAD_RIGHT_THUMB_DEADZONE, pixelsPerSecond, elapsedSeconds);
+            ClampToBounds(primary.X, primary.Y, m_bounds);
+            ClampToBounds(secondary.X, secondary.Y, m_bounds);
+
+            primary.Down = (pad.wButtons & XINPUT_GAMEPAD_A) != 0 && !chord;
+            secondary.Down = pad.bRightTrigger >= CONTACT_TRIGGER_THRESHOLD;
+        }
+    }
+
+    // One InjectTouchInput per frame carrying every contact that is down or just lifted.
+    void Pipeline::InjectFrame(LONGLONG sampleTick) {
+        UINT32 count = 0;
+        for (DWORD index = 0; index < MAX_CONTROLLERS; ++index) {
+            for (DWORD c = 0; c < CONTACTS_PER_CONTROLLER; ++c) {
+                Contact& contact = m_controllers[index].Contacts[c];
+                if (!contact.Down && !contact.WasDown) continue;
+
+                LONG x = (LONG)contact.X;
+                LONG y = (LONG)contact.Y;
+                POINTER_TOUCH_INFO& info = m_frame[count++];
+                info = {};
+                info.pointerInfo.pointerType = PT_TOUCH;
+                info.pointerInfo.pointerId = FIRST_POINTER_ID + index * CONTACTS_PER_CONTROLLER + c;
+                info.pointerInfo.ptPixelLocation.x = x;
+                info.pointerInfo.ptPixelLocation.y = y;
+                if (!contact.Down) info.pointerInfo.pointerFlags = POINTER_FLAG_UP;
+                else if (!contact.WasDown) info.pointerInfo.pointerFlags = POINTER_FLAG_DOWN | POINTER_FLAG_INRANGE | POINTER_FLAG_INCONTACT;
+                else info.pointerInfo.pointerFlags = POINTER_FLAG_UPDATE | POINTER_FLAG_INRANGE | POINTER_FLAG_INCONTACT;
+                info.touchFlags = TOUCH_FLAG_NONE;
+                info.touchMask = TOUCH_MASK_CONTACTAREA | TOUCH_MASK_ORIENTATION | TOUCH_MASK_PRESSURE;
+                info.rcContact = { x - CONTACT_RADIUS, y - CONTACT_RADIUS, x + CONTACT_RADIUS, y + CONTACT_RADIUS };
+                info.orientation = 90;
+                info.pressure = CONTACT_PRESSURE;
+                contact.WasDown = contact.Down;
+            }
+        }
+        if (count == 0) return;
+
+        if (m_config.InjectTouchInput(count, m_frame)) {
+            RecordLatency((Trace::Timestamp() - sampleTick) * 1000000 / m_qpcFrequency);
+            return;
+        }
+
+        // Typically the secure desktop took input. Forget the contacts so held ones go down again freshly.
+        DWORD dwErr = GetLastError();
+        if (m_stats.Failures++ == 0) LogDebug(L"GamepadTouch: InjectTouchInput failed (Error: %d).", dwErr);
+        for (auto& controller : m_controllers) {
+            for (auto& contact : controller.Contacts) contact.WasDown = false;
+        }
+    }
+
+    void Pipeline::ReleaseAllContacts(LONGLONG sampleTick) {
+        for (auto& controller : m_controllers) {
+            for (auto& contact : controller.Contacts) contact.Down = false;
+        }
+        InjectFrame(sampleTick);
+    }
+
+    void Pipeline::UpdateBounds() {
+        MONITORINFO info = { sizeof(info) };
+        HMONITOR hMonitor = MonitorFromPoint({ 0, 0 }, MONITOR_DEFAULTTOPRIMARY);
+        if (!hMonitor || !GetMonitorInfoW(hMonitor, &info)) return;
+        if (EqualRect(&info.rcMonitor, &m_bounds)) return;
+
+        m_bounds = info.rcMonitor;
+        LogDebug(L"GamepadTouch: Primary monitor bounds (%ld,%ld)-(%ld,%ld).", m_bounds.left, m_bounds.top, m_bounds.right, m_bounds.bottom);
+        for (auto& controller : m_controllers) {
+            for (auto& contact : controller.Contacts) ClampToBounds(contact.X, contact.Y, m_bounds);
+        }
+    }
+
+    void Pipeline::RecordLatency(LONGLONG latencyUs) {
+        size_t bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && (1LL << bucket) <= latencyUs) ++bucket;
+        m_stats.Buckets[bucket]++;
+        m_stats.Frames++;
+        m_stats.TotalUs += latencyUs;
+        if (latencyUs > m_stats.MaxUs) m_stats.MaxUs = latencyUs;
+    }
+
+    // Percentiles are bucket upper bounds. Each line covers the frames since the previous one.
+    void Pipeline::LogStats(const wchar_t* reason) {
+        if (m_stats.Frames == 0 && m_stats.Failures == 0) return;
+
+        LONGLONG p50 = 0;
+        LONGLONG p99 = 0;
+        ULONGLONG seen = 0;
+        for (size_t bucket = 0; bucket < LATENCY_BUCKETS; ++bucket) {
+            seen += m_stats.Buckets[bucket];
+            if (!p50 && seen * 2 >= m_stats.Frames) p50 = 1LL << bucket;
+            if (!p99 && seen * 100 >= m_stats.Frames * 99) p99 = 1LL << bucket;
+        }
+
+        LogDebug(L"GamepadTouch: %s: %llu frames injected, %llu failed. Input-to-inject mean %lld us, p50 <= %lld us, p99 <= %lld us, max %lld us.",
+            reason, m_stats.Frames, m_stats.Failures, m_stats.Frames ? m_stats.TotalUs / (LONGLONG)m_stats.Frames : 0, p50, p99, m_stats.MaxUs);
+        m_stats = {};
+    }
+}
\ No newline at end of file
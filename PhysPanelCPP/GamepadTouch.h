@@ -0,0 +1,110 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+
+namespace GamepadTouch {
+
+    typedef BOOL(WINAPI* PInjectTouchInput)(UINT32, const POINTER_TOUCH_INFO*);
+
+    // Matches the InitializeTouchInjection contact count used by the touch worker.
+    const UINT32 MAX_CONTACTS = 10;
+    const DWORD MAX_CONTROLLERS = 4; // XUSER_MAX_COUNT
+    const DWORD CONTACTS_PER_CONTROLLER = 2;
+    const size_t LATENCY_BUCKETS = 24; // Powers of two in microseconds.
+
+    struct Config {
+        HDESK hDesktop;                 // Attached by the input thread; must stay open until Stop.
+        PInjectTouchInput InjectTouchInput;
+        HANDLE hDisplayOnEvent;         // Optional gates, as for the touch probe. NULL: assume open.
+        HANDLE hSessionActiveEvent;
+    };
+
+    // Drives touch contacts from XInput controllers on a dedicated high-priority thread. A controller
+    // takes over touch after the View+Menu chord (pressed again to release it). The left stick then
+    // moves a contact pressed with A, the right stick a second one pressed with the right trigger, for
+    // pinch and rotate. Frames are sampled from a high-resolution waitable timer at a fixed cadence and
+    // injected as one batch, with nothing allocated after Start.
+    class Pipeline {
+    public:
+        Pipeline() = default;
+        ~Pipeline() { Stop(); }
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        // Returns false when XInput is unavailable or the thread cannot start.
+        bool Start(const Config& config);
+
+        // Lifts any held contacts and joins the thread.
+        void Stop();
+
+    private:
+        struct Contact {
+            double X;
+            double Y;
+            bool Down;
+            bool WasDown;
+        };
+
+        struct Controller {
+            bool Connected;
+            bool Engaged;
+            bool ChordHeld;
+            Contact Contacts[CONTACTS_PER_CONTROLLER];
+        };
+
+        // Input-to-inject latency: from the frame's scheduled sample time to InjectTouchInput returning.
+        struct LatencyStats {
+            ULONGLONG Frames;
+            ULONGLONG Failures;
+            LONGLONG TotalUs;
+            LONGLONG MaxUs;
+            ULONG Buckets[LATENCY_BUCKETS];
+        };
+
+        static DWORD WINAPI ThreadProc(LPVOID param);
+
+        void Run();
+
+        bool WaitForGates(bool& paused);
+
+        void PollControllers(bool rescan, double elapsedSeconds);
+
+        void InjectFrame(LONGLONG sampleTick);
+
+        void ReleaseAllContacts(LONGLONG sampleTick);
+
+        void UpdateBounds();
+
+        void RecordLatency(LONGLONG latencyUs);
+
+        void LogStats(const wchar_t* reason);
+
+        Config m_config = {};
+        HMODULE m_hXInput = NULL;
+        FARPROC m_pXInputGetState = nullptr;
+        HANDLE m_hThread = NULL;
+        HANDLE m_hStopEvent = NULL;
+        HANDLE m_hTimer = NULL;
+        LONGLONG m_qpcFrequency = 0;
+        RECT m_bounds = {};
+        Controller m_controllers[MAX_CONTROLLERS] = {};
+        POINTER_TOUCH_INFO m_frame[MAX_CONTACTS] = {};
+        LatencyStats m_stats = {};
+    };
+}
\ No newline at end of file
@@ -17,6 +17,15 @@
 #include "pch.h"
 #include "KeyboardManager.h"
 #include "Utils.h"
+#include "Trace.h"
+#include <comdef.h>
+#include <ShlObj.h>
+#include <TlHelp32.h>
+#include <wtsapi32.h>
+#include <functional>
+#include <future>
+
+#pragma comment(lib, "Wtsapi32.lib")
 
 std::string WstringToString(const std::wstring& wstr) {
     if (wstr.empty()) return std::string();
@@ -41,167 +50,864 @@ namespace KeyboardManager {
         virtual HRESULT __stdcall Location(RECT* prcInputPaneScreenLocation) = 0;
     };
 
+    struct __declspec(uuid("226C537B-1E76-4D9E-A760-33DB29922F18")) IFrameworkInputPaneHandler : IUnknown {
+        virtual HRESULT __stdcall Showing(RECT* prcInputPaneScreenLocation, BOOL fEnsureFocusedElementInView) = 0;
+        virtual HRESULT __stdcall Hiding(BOOL fEnsureFocusedElementInView) = 0;
+    };
+
     constexpr auto TABTIP_PROCESS_NAME = L"TabTip.exe";
     constexpr auto SHELL_PROCESS_NAME = L"explorer.exe";
+    constexpr auto SHELL_TRAY_CLASS = L"Shell_TrayWnd";
+    constexpr auto TABTIP_WINDOW_CLASS = L"IPTip_Main_Window";
+    constexpr auto SHELL_READY_EVENT_NAME = L"ShellReadyEvent";
+    constexpr auto TRACKER_WINDOW_CLASS = L"XFEST_InputPaneTracker";
+    constexpr auto AGENT_WINDOW_CLASS = L"XFEST_KeyboardAgent";
+    constexpr auto AGENT_MUTEX_NAME = L"Local\\XFEST_KeyboardAgent";
+    constexpr UINT WM_AGENT_ACTIVATE = WM_APP + 1;
+    const UINT AGENT_SIGNAL_TIMEOUT_MS = 2000;
+    const auto AGENT_RELAUNCH_COOLDOWN = std::chrono::seconds(5);
     const auto SHELL_READY_TIMEOUT = std::chrono::seconds(30);
+    const auto TABTIP_READY_TIMEOUT = std::chrono::seconds(10);
     const auto COM_SERVICE_TIMEOUT = std::chrono::seconds(15);
+    const auto PROCESS_POLL_INTERVAL = std::chrono::milliseconds(500);
+    const auto VISIBILITY_POLL_INTERVAL = std::chrono::milliseconds(250);
 
-    bool IsProcessRunning(const wchar_t* processName) {
+    DWORD FindProcessId(const wchar_t* processName) {
         HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-        if (snapshot == INVALID_HANDLE_VALUE) return false;
+        if (snapshot == INVALID_HANDLE_VALUE) return 0;
         PROCESSENTRY32W entry;
         entry.dwSize = sizeof(entry);
-        bool found = false;
+        DWORD pid = 0;
         if (Process32FirstW(snapshot, &entry)) {
             do {
                 if (_wcsicmp(entry.szExeFile, processName) == 0) {
-                    found = true;
+                    pid = entry.th32ProcessID;
                     break;
                 }
             } while (Process32NextW(snapshot, &entry));
         }
         CloseHandle(snapshot);
-        return found;
+        return pid;
+    }
+
+    bool IsProcessRunning(const wchar_t* processName) {
+        return FindProcessId(processName) != 0;
     }
 
-    bool WaitForProcess(const wchar_t* processName, std::chrono::milliseconds timeout) {
-        LogDebug(L"Waiting for process: %s", processName);
-        auto start = std::chrono::high_resolution_clock::now();
-        while (std::chrono::high_resolution_clock::now() - start < timeout) {
-            if (IsProcessRunning(processName)) {
-                LogDebug(L"Process found: %s", processName);
-                return true;
+    bool IsShellWindowPresent() {
+        return GetShellWindow() != NULL || FindWindowW(SHELL_TRAY_CLASS, NULL) != NULL;
+    }
+
+    bool IsTabTipWindowPresent() {
+        return FindWindowW(TABTIP_WINDOW_CLASS, NULL) != NULL;
+    }
+
+    // Shared waiting engine for the shell, TabTip and visibility phases.
+    // Wakes up on window creation/show notifications (out-of-context WinEvent hook) and on an optional
+    // kernel signal, so the readiness checks only run when something on the desktop actually changed.
+    // If the hook cannot be installed, it degrades to plain polling at the caller's interval.
+    class ReadinessWaiter {
+    public:
+        ReadinessWaiter() {
+            s_eventPending = false;
+            m_hook = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_SHOW, NULL, WinEventProc, 0, 0,
+                WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+            if (m_hook) {
+                LogDebug(L"ReadinessWaiter: WinEvent hook installed (event-driven mode).");
+            }
+            else {
+                LogDebug(L"ReadinessWaiter: SetWinEventHook failed (Error: %d). Falling back to polling.", GetLastError());
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
         }
-        LogDebug(L"Wait for process TIMEOUT: %s", processName);
-        return false;
-    }
 
-    bool IsTouchKeyboardVisible() {
-        bool isVisible = false;
-        IFrameworkInputPane* pInputPane = nullptr;
+        ~ReadinessWaiter() {
+            if (m_hook) UnhookWinEvent(m_hook);
+        }
 
-        HRESULT hr = CoCreateInstance(__uuidof(FrameworkInputPane), NULL, CLSCTX_INPROC_SERVER, __uuidof(IFrameworkInputPane), (void**)&pInputPane);
+        ReadinessWaiter(const ReadinessWaiter&) = delete;
+        ReadinessWaiter& operator=(const ReadinessWaiter&) = delete;
 
-        if (SUCCEEDED(hr) && pInputPane) {
-            RECT rc = { 0 };
-            hr = pInputPane->Location(&rc);
+        // onEvent: cheap check run after each relevant window notification.
+        // onPoll:  authoritative check run on entry and on every fallback tick.
+        bool Wait(const std::function<bool()>& onEvent, const std::function<bool()>& onPoll,
+            std::chrono::milliseconds timeout, std::chrono::milliseconds pollInterval, HANDLE signal = NULL) {
+            if (m_quitSeen) return false;
+            if (onPoll()) return true;
 
-            if (SUCCEEDED(hr)) {
-                if ((rc.right - rc.left) > 0 && (rc.bottom - rc.top) > 0) {
-                    isVisible = true;
-                    LogDebug(L"IFrameworkInputPane State: Visible (Rect: %d x %d)", (rc.right - rc.left), (rc.bottom - rc.top));
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            auto nextTick = std::chrono::steady_clock::now() + pollInterval;
+            const DWORD handleCount = signal ? 1 : 0;
+
+            while (true) {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= deadline) return false;
+
+                auto wakeAt = (std::min)(deadline, nextTick);
+                // nextTick can already be behind us when onEvent ran long; never let the cast wrap to INFINITE.
+                DWORD waitMs = (DWORD)(std::max<long long>)(0, std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count());
+
+                DWORD waitResult = MsgWaitForMultipleObjects(handleCount, signal ? &signal : NULL, FALSE, waitMs, QS_ALLINPUT);
+
+                if (handleCount && waitResult == WAIT_OBJECT_0) {
+                    LogDebug(L"ReadinessWaiter: Ready signal set.");
+                    return true;
                 }
+
+                if (waitResult == WAIT_OBJECT_0 + handleCount) {
+                    if (PumpMessages()) {
+                        LogDebug(L"ReadinessWaiter: WM_QUIT received. Abandoning wait.");
+                        m_quitSeen = true;
+                        return false;
+                    }
+                    if (s_eventPending) {
+                        s_eventPending = false;
+                        if (onEvent()) return true;
+                    }
+                    if (std::chrono::steady_clock::now() < nextTick) continue;
+                }
+                else if (waitResult == WAIT_FAILED) {
+                    LogDebug(L"ReadinessWaiter: MsgWaitForMultipleObjects failed (Error: %d).", GetLastError());
+                    std::this_thread::sleep_for(pollInterval);
+                }
+
+                if (onPoll()) return true;
+                nextTick = std::chrono::steady_clock::now() + pollInterval;
+            }
+        }
+
+        // Set once a wait consumed WM_QUIT; every later wait fails immediately. Owners of a message loop
+        // check this instead of expecting the message to be re-posted.
+        bool QuitSeen() const { return m_quitSeen; }
+
+    private:
+        static void CALLBACK WinEventProc(HWINEVENTHOOK, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD) {
+            if (event == EVENT_OBJECT_DESTROY || !hwnd) return;
+            if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF) return;
+            s_eventPending = true;
+        }
+
+        // Returns true when WM_QUIT was dequeued.
+        static bool PumpMessages() {
+            MSG msg;
+            while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+                if (msg.message == WM_QUIT) return true;
+                TranslateMessage(&msg);
+                DispatchMessageW(&msg);
             }
-            pInputPane->Release();
+            return false;
         }
 
-        return isVisible;
+        HWINEVENTHOOK m_hook = nullptr;
+        bool m_quitSeen = false;
+        // Out-of-context WinEvent callbacks are delivered on the installing thread, so no synchronization is needed.
+        static bool s_eventPending;
+    };
+
+    bool ReadinessWaiter::s_eventPending = false;
+
+    bool WaitForShell(ReadinessWaiter& waiter) {
+        Trace::PhaseScope trace(L"Keyboard", L"WaitForShell");
+        LogDebug(L"Waiting for Windows Shell...");
+        HANDLE hShellReady = OpenEventW(SYNCHRONIZE, FALSE, SHELL_READY_EVENT_NAME);
+        bool ready = waiter.Wait(
+            IsShellWindowPresent,
+            [] { return IsShellWindowPresent() || IsProcessRunning(SHELL_PROCESS_NAME); },
+            SHELL_READY_TIMEOUT, PROCESS_POLL_INTERVAL, hShellReady);
+        if (hShellReady) CloseHandle(hShellReady);
+        trace.SetStatus(ready ? ERROR_SUCCESS : WAIT_TIMEOUT);
+        LogDebug(ready ? L"Windows Shell is ready." : L"Wait for Windows Shell TIMEOUT.");
+        return ready;
     }
 
-    void StartTouchKeyboard() {
-        LogDebug(L"--- StartTouchKeyboard() [Mode: Start -> Poll -> Hide] ---");
+    bool WaitForTabTip(ReadinessWaiter& waiter) {
+        Trace::PhaseScope trace(L"Keyboard", L"WaitForTabTip");
+        LogDebug(L"Waiting for process: %s", TABTIP_PROCESS_NAME);
+        bool ready = waiter.Wait(
+            IsTabTipWindowPresent,
+            [] { return IsTabTipWindowPresent() || IsProcessRunning(TABTIP_PROCESS_NAME); },
+            TABTIP_READY_TIMEOUT, PROCESS_POLL_INTERVAL);
+        trace.SetStatus(ready ? ERROR_SUCCESS : WAIT_TIMEOUT);
+        LogDebug(ready ? L"Process found: %s" : L"Wait for process TIMEOUT: %s", TABTIP_PROCESS_NAME);
+        return ready;
+    }
+
+    // Logs per-stage durations so the boot-to-keyboard critical path can be read from the debug log,
+    // and mirrors each stage as an ETW phase event.
+    class StageTimer {
+    public:
+        StageTimer() : m_origin(Trace::Timestamp()), m_stageStart(m_origin) {}
+
+        void Mark(const wchar_t* stage) {
+            Trace::Phase(L"Keyboard", stage, m_stageStart, 0);
+            LogDebug(L"[Stage] %s: %lld ms (T+%lld ms)", stage,
+                (long long)(Trace::ElapsedUs(m_stageStart) / 1000),
+                (long long)(Trace::ElapsedUs(m_origin) / 1000));
+            m_stageStart = Trace::Timestamp();
+        }
+
+    private:
+        LONGLONG m_origin;
+        LONGLONG m_stageStart;
+    };
+
+    std::wstring ResolveTabTipPath() {
+        PWSTR pszPath = nullptr;
+        HRESULT hr_path = SHGetKnownFolderPath(FOLDERID_ProgramFilesCommon, 0, NULL, &pszPath);
+        if (FAILED(hr_path)) {
+            LogDebug(L"Error: Failed to retrieve FOLDERID_ProgramFilesCommon.");
+            throw TabTipNotFoundException("Failed to retrieve Common Program Files path.");
+        }
+
+        std::wstring tabTipPath(pszPath);
+        CoTaskMemFree(pszPath);
+        tabTipPath += L"\\Microsoft Shared\\ink\\TabTip.exe";
+        LogDebug(L"TabTip path: %s", tabTipPath.c_str());
+
+        DWORD fileAttr = GetFileAttributesW(tabTipPath.c_str());
+        if (fileAttr == INVALID_FILE_ATTRIBUTES || (fileAttr & FILE_ATTRIBUTE_DIRECTORY)) {
+            LogDebug(L"Warning: TabTip.exe not found at expected path.");
+            throw TabTipNotFoundException("TabTip.exe not found at its expected path.");
+        }
+
+        return tabTipPath;
+    }
+
+    bool IsDisconnectError(HRESULT hr) {
+        return hr == RPC_E_DISCONNECTED ||
+            hr == RPC_E_SERVER_DIED ||
+            hr == RPC_E_SERVER_DIED_DNE ||
+            hr == CO_E_OBJNOTCONNECTED ||
+            hr == HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE) ||
+            hr == HRESULT_FROM_WIN32(RPC_S_CALL_FAILED);
+    }
+
+    // Receives Showing/Hiding callbacks from the input pane and mirrors them into a manual-reset event,
+    // so waits can wake up the moment the keyboard appears instead of on the next Location() poll.
+    // Callbacks arrive through the STA message pump of the thread that advised.
+    class InputPaneVisibilityTracker : public IFrameworkInputPaneHandler {
+    public:
+        static InputPaneVisibilityTracker* Create() {
+            HWND hwnd = CreateTrackerWindow();
+            if (!hwnd) return nullptr;
+
+            HANDLE hShown = CreateEventW(NULL, TRUE, FALSE, NULL);
+            if (!hShown) {
+                DestroyWindow(hwnd);
+                return nullptr;
+            }
+            return new InputPaneVisibilityTracker(hwnd, hShown);
+        }
+
+        HRESULT Advise(IFrameworkInputPane* pInputPane) {
+            Unadvise();
+            HRESULT hr = pInputPane->AdviseWithHWND(m_hwnd, static_cast<IFrameworkInputPaneHandler*>(this), &m_cookie);
+            if (SUCCEEDED(hr)) {
+                m_pInputPane = pInputPane;
+                m_pInputPane->AddRef();
+            }
+            else {
+                m_cookie = 0;
+            }
+            return hr;
+        }
 
-        if (!IsProcessRunning(TABTIP_PROCESS_NAME)) {
-            PWSTR pszPath = nullptr;
-            HRESULT hr_path = SHGetKnownFolderPath(FOLDERID_ProgramFilesCommon, 0, NULL, &pszPath);
-            if (FAILED(hr_path)) {
-                LogDebug(L"Error: Failed to retrieve FOLDERID_ProgramFilesCommon.");
-                throw TabTipNotFoundException("Failed to retrieve Common Program Files path.");
+        void Unadvise() {
+            if (m_pInputPane) {
+                m_pInputPane->Unadvise(m_cookie);
+                m_pInputPane->Release();
+                m_pInputPane = nullptr;
+                m_cookie = 0;
             }
+        }
+
+        bool IsAdvised() const { return m_pInputPane != nullptr; }
+        bool IsVisible() const { return m_visible; }
+        HANDLE ShownEvent() const { return m_hShown; }
+
+        // IUnknown
+        HRESULT __stdcall QueryInterface(REFIID riid, void** ppv) override {
+            if (!ppv) return E_POINTER;
+            if (riid == __uuidof(IUnknown) || riid == __uuidof(IFrameworkInputPaneHandler)) {
+                *ppv = static_cast<IFrameworkInputPaneHandler*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppv = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        ULONG __stdcall AddRef() override {
+            return InterlockedIncrement(&m_refCount);
+        }
 
-            std::wstring tabTipPath(pszPath);
-            CoTaskMemFree(pszPath);
-            tabTipPath += L"\\Microsoft Shared\\ink\\TabTip.exe";
-            LogDebug(L"TabTip path: %s", tabTipPath.c_str());
+        ULONG __stdcall Release() override {
+            LONG count = InterlockedDecrement(&m_refCount);
+            if (count == 0) delete this;
+            return count;
+        }
 
-            DWORD fileAttr = GetFileAttributesW(tabTipPath.c_str());
-            if (fileAttr == INVALID_FILE_ATTRIBUTES || (fileAttr & FILE_ATTRIBUTE_DIRECTORY)) {
-                LogDebug(L"Warning: TabTip.exe not found at expected path.");
-                throw TabTipNotFoundException("TabTip.exe not found at its expected path.");
+        // IFrameworkInputPaneHandler
+        HRESULT __stdcall Showing(RECT* prcInputPaneScreenLocation, BOOL) override {
+            m_visible = true;
+            SetEvent(m_hShown);
+            if (prcInputPaneScreenLocation) {
+                LogDebug(L"InputPaneVisibilityTracker: Showing (Rect: %d x %d)",
+                    prcInputPaneScreenLocation->right - prcInputPaneScreenLocation->left,
+                    prcInputPaneScreenLocation->bottom - prcInputPaneScreenLocation->top);
             }
+            return S_OK;
+        }
 
-            if (!WaitForProcess(SHELL_PROCESS_NAME, SHELL_READY_TIMEOUT)) {
-                throw TabTipActivationException("Timed out waiting for Windows Shell (explorer.exe).");
+        HRESULT __stdcall Hiding(BOOL) override {
+            m_visible = false;
+            ResetEvent(m_hShown);
+            LogDebug(L"InputPaneVisibilityTracker: Hiding");
+            return S_OK;
+        }
+
+    private:
+        InputPaneVisibilityTracker(HWND hwnd, HANDLE hShown) : m_hwnd(hwnd), m_hShown(hShown) {}
+
+        ~InputPaneVisibilityTracker() {
+            Unadvise();
+            if (m_hShown) CloseHandle(m_hShown);
+            if (m_hwnd) DestroyWindow(m_hwnd);
+        }
+
+        static HWND CreateTrackerWindow() {
+            HINSTANCE hInstance = GetModuleHandleW(NULL);
+            WNDCLASSEXW wc = { sizeof(wc) };
+            wc.lpfnWndProc = DefWindowProcW;
+            wc.hInstance = hInstance;
+            wc.lpszClassName = TRACKER_WINDOW_CLASS;
+            if (!RegisterClassExW(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+                LogDebug(L"InputPaneVisibilityTracker: RegisterClassExW failed (Error: %d).", GetLastError());
+                return NULL;
             }
 
-            LogDebug(L"Launching TabTip.exe service via ShellExecuteW...");
-            ShellExecuteW(NULL, L"open", tabTipPath.c_str(), NULL, NULL, SW_SHOWNORMAL);
+            HWND hwnd = CreateWindowExW(WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE, TRACKER_WINDOW_CLASS, L"", WS_POPUP,
+                0, 0, 0, 0, NULL, NULL, hInstance, NULL);
+            if (!hwnd) {
+                LogDebug(L"InputPaneVisibilityTracker: CreateWindowExW failed (Error: %d).", GetLastError());
+            }
+            return hwnd;
+        }
 
-            WaitForProcess(TABTIP_PROCESS_NAME, std::chrono::seconds(10));
-        } else {
-            LogDebug(L"TabTip.exe is already running. Skipping launch, proceeding to visibility check.");
+        LONG m_refCount = 1;
+        HWND m_hwnd = NULL;
+        HANDLE m_hShown = NULL;
+        IFrameworkInputPane* m_pInputPane = nullptr;
+        DWORD m_cookie = 0;
+        bool m_visible = false;
+    };
+
+    // Owns the input pane and TipInvocation proxies for one run so the visibility checks and the
+    // hide call reuse a single activation. Proxies are rebuilt only after RPC-disconnected errors.
+    // Must be released on the apartment thread before CoUninitialize.
+    class KeyboardSession {
+    public:
+        KeyboardSession() = default;
+        ~KeyboardSession() { Reset(); }
+
+        KeyboardSession(const KeyboardSession&) = delete;
+        KeyboardSession& operator=(const KeyboardSession&) = delete;
+
+        IFrameworkInputPane* InputPane() {
+            if (!m_pInputPane) {
+                HRESULT hr = CoCreateInstance(__uuidof(FrameworkInputPane), NULL, CLSCTX_INPROC_SERVER, __uuidof(IFrameworkInputPane), (void**)&m_pInputPane);
+                if (FAILED(hr)) {
+                    LogDebug(L"KeyboardSession: FrameworkInputPane activation failed (0x%08X).", hr);
+                    m_pInputPane = nullptr;
+                }
+                else if (m_pTracker) {
+                    m_pTracker->Advise(m_pInputPane);
+                }
+            }
+            return m_pInputPane;
         }
 
-        bool comInitialized = false;
-        try {
-            LogDebug(L"Initializing COM for visibility polling and control...");
-            HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-            if (SUCCEEDED(hr)) {
-                comInitialized = true;
+        ITipInvocation* Tip() {
+            if (!m_pTip) {
+                HRESULT hr = CoCreateInstance(__uuidof(TipInvocation), NULL, CLSCTX_LOCAL_SERVER, __uuidof(ITipInvocation), (void**)&m_pTip);
+                if (FAILED(hr)) m_pTip = nullptr;
             }
+            return m_pTip;
+        }
+
+        bool IsKeyboardVisible() {
+            for (int attempt = 0; attempt < 2; ++attempt) {
+                IFrameworkInputPane* pInputPane = InputPane();
+                if (!pInputPane) return false;
+
+                RECT rc = { 0 };
+                HRESULT hr = pInputPane->Location(&rc);
+                if (SUCCEEDED(hr)) {
+                    if ((rc.right - rc.left) > 0 && (rc.bottom - rc.top) > 0) {
+                        LogDebug(L"IFrameworkInputPane State: Visible (Rect: %d x %d)", (rc.right - rc.left), (rc.bottom - rc.top));
+                        return true;
+                    }
+                    return false;
+                }
+                if (!IsDisconnectError(hr)) return false;
 
-            LogDebug(L"Starting visibility poll (max 10s)...");
-            bool visible = false;
-            auto pollStart = std::chrono::high_resolution_clock::now();
+                LogDebug(L"KeyboardSession: Input pane disconnected (0x%08X). Rebuilding.", hr);
+                ReleaseInputPane();
+            }
+            return false;
+        }
 
-            while (std::chrono::high_resolution_clock::now() - pollStart < COM_SERVICE_TIMEOUT) {
-                if (IsTouchKeyboardVisible()) {
-                    visible = true;
-                    LogDebug(L"Poll Result: Keyboard is VISIBLE.");
-                    break;
+        // Subscribes to Showing/Hiding and returns an event that is set while the keyboard is visible,
+        // or NULL when the subscription is unavailable and callers have to rely on Location() checks.
+        HANDLE VisibilitySignal() {
+            if (!m_pTracker) {
+                m_pTracker = InputPaneVisibilityTracker::Create();
+                if (!m_pTracker) return NULL;
+            }
+            if (!m_pTracker->IsAdvised()) {
+                IFrameworkInputPane* pInputPane = InputPane();
+                if (!pInputPane) return NULL;
+
+                HRESULT hr = m_pTracker->Advise(pInputPane);
+                if (FAILED(hr)) {
+                    LogDebug(L"KeyboardSession: AdviseWithHWND failed (0x%08X). Using Location() checks only.", hr);
+                    return NULL;
                 }
+                LogDebug(L"KeyboardSession: Subscribed to input pane visibility changes.");
+            }
+            return m_pTracker->ShownEvent();
+        }
+
+        bool ConnectTip(std::chrono::milliseconds timeout) {
+            auto start = std::chrono::steady_clock::now();
+            while (!Tip()) {
+                if (std::chrono::steady_clock::now() - start >= timeout) return false;
                 std::this_thread::sleep_for(std::chrono::milliseconds(250));
             }
+            return true;
+        }
 
-            if (visible) {
-                LogDebug(L"Action: Keyboard visible. Toggling to HIDE.");
+        HRESULT Toggle(HWND hwnd) {
+            HRESULT hr = E_POINTER;
+            for (int attempt = 0; attempt < 2; ++attempt) {
+                ITipInvocation* pTip = Tip();
+                if (!pTip) return REGDB_E_CLASSNOTREG;
 
-                ITipInvocation* pTip = nullptr;
-                auto start = std::chrono::high_resolution_clock::now();
+                hr = pTip->Toggle(hwnd);
+                if (!IsDisconnectError(hr)) return hr;
 
-                while (std::chrono::high_resolution_clock::now() - start < COM_SERVICE_TIMEOUT) {
-                    hr = CoCreateInstance(__uuidof(TipInvocation), NULL, CLSCTX_LOCAL_SERVER, __uuidof(ITipInvocation), (void**)&pTip);
-                    if (SUCCEEDED(hr)) break;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(250));
-                }
+                LogDebug(L"KeyboardSession: TipInvocation disconnected (0x%08X). Reconnecting.", hr);
+                ReleaseTip();
+            }
+            return hr;
+        }
 
-                if (pTip) {
-                    LogDebug(L"COM service connected. Invoking Toggle() to HIDE keyboard.");
-                    pTip->Toggle(GetDesktopWindow());
-                    pTip->Release();
-                    LogDebug(L"Keyboard hidden successfully.");
-                }
-                else {
-                    LogDebug(L"FAILED to connect to COM service (pTip is null). Cannot HIDE keyboard.");
-                    throw TabTipActivationException("Failed to connect to TabTip COM interface (Keyboard detected but unresponsive).");
+        void ReleaseInputPane() {
+            if (m_pTracker) m_pTracker->Unadvise();
+            if (m_pInputPane) {
+                m_pInputPane->Release();
+                m_pInputPane = nullptr;
+            }
+        }
+
+        void ReleaseTip() {
+            if (m_pTip) {
+                m_pTip->Release();
+                m_pTip = nullptr;
+            }
+        }
+
+        void Reset() {
+            ReleaseTip();
+            ReleaseInputPane();
+            if (m_pTracker) {
+                m_pTracker->Release();
+                m_pTracker = nullptr;
+            }
+        }
+
+    private:
+        InputPaneVisibilityTracker* m_pTracker = nullptr;
+        IFrameworkInputPane* m_pInputPane = nullptr;
+        ITipInvocation* m_pTip = nullptr;
+    };
+
+    // Launches TabTip when it is not running, waits for the keyboard to appear and hides it.
+    // Shared by the one-shot StartTouchKeyboard path and the resident keyboard agent. With ensureOnly set,
+    // a running TabTip is left alone; only a relaunch is followed by the visibility wait and hide.
+    void RunKeyboardSequence(ReadinessWaiter& waiter, KeyboardSession& session, StageTimer& timer,
+        const std::function<std::wstring()>& getTabTipPath, bool ensureOnly = false) {
+        bool running = IsProcessRunning(TABTIP_PROCESS_NAME);
+        if (running && ensureOnly) {
+            LogDebug(L"TabTip.exe is already running. Nothing to do.");
+            return;
+        }
+
+        HANDLE hKeyboardShown = session.VisibilitySignal();
+
+        // A keyboard the user already had open is not ours to hide.
+        if (session.IsKeyboardVisible()) {
+            LogDebug(L"Keyboard was already visible before the sequence. Leaving it shown.");
+            Trace::Milestone(L"Keyboard", L"KeyboardReady", (DWORD)S_FALSE);
+            return;
+        }
+
+        if (!running) {
+            std::wstring tabTipPath = getTabTipPath();
+            timer.Mark(L"TabTip path resolved");
+
+            if (!WaitForShell(waiter)) {
+                throw TabTipActivationException("Timed out waiting for Windows Shell (explorer.exe).");
+            }
+            timer.Mark(L"Windows Shell ready");
+
+            LogDebug(L"Launching TabTip.exe service via ShellExecuteW...");
+            ShellExecuteW(NULL, L"open", tabTipPath.c_str(), NULL, NULL, SW_SHOWNORMAL);
+
+            WaitForTabTip(waiter);
+            timer.Mark(L"TabTip launched");
+        }
+        else {
+            LogDebug(L"TabTip.exe is already running. Skipping launch, proceeding to visibility check.");
+        }
+
+        // Warm the TipInvocation proxy now so the hide call does not pay for activation later.
+        if (session.Tip()) {
+            timer.Mark(L"TipInvocation connected");
+        }
+
+        LogDebug(L"Waiting for keyboard visibility (max 15s)...");
+        auto isVisible = [&]() { return session.IsKeyboardVisible(); };
+        bool visible = waiter.Wait(isVisible, isVisible, COM_SERVICE_TIMEOUT, VISIBILITY_POLL_INTERVAL, hKeyboardShown);
+        timer.Mark(L"Visibility wait");
+
+        if (visible) {
+            LogDebug(L"Wait Result: Keyboard is VISIBLE.");
+            LogDebug(L"Action: Keyboard visible. Toggling to HIDE.");
+
+            if (session.ConnectTip(COM_SERVICE_TIMEOUT)) {
+                // Toggle() flips the state, so re-check right before calling it in case the pane closed meanwhile.
+                if (!session.IsKeyboardVisible()) {
+                    LogDebug(L"Keyboard is no longer visible. Skipping Toggle().");
+                    Trace::Milestone(L"Keyboard", L"KeyboardReady", (DWORD)S_FALSE);
+                    return;
                 }
+                LogDebug(L"COM service connected. Invoking Toggle() to HIDE keyboard.");
+                HRESULT hr = session.Toggle(GetDesktopWindow());
+                timer.Mark(L"Keyboard hidden");
+                Trace::Milestone(L"Keyboard", L"KeyboardReady", (DWORD)hr);
+                LogDebug(L"Keyboard hidden (Toggle HRESULT: 0x%08X).", hr);
             }
             else {
-                LogDebug(L"Poll Completed: Keyboard never appeared. Assuming silent background execution.");
+                LogDebug(L"FAILED to connect to COM service (TipInvocation unavailable). Cannot HIDE keyboard.");
+                throw TabTipActivationException("Failed to connect to TabTip COM interface (Keyboard detected but unresponsive).");
             }
+        }
+        else {
+            LogDebug(L"Wait Completed: Keyboard never appeared. Assuming silent background execution.");
+            Trace::Milestone(L"Keyboard", L"KeyboardReady", WAIT_TIMEOUT);
+        }
+    }
+
+    bool SignalAgent() {
+        HWND hwnd = FindWindowW(AGENT_WINDOW_CLASS, NULL);
+        if (!hwnd) return false;
+
+        DWORD_PTR result = 0;
+        if (!SendMessageTimeoutW(hwnd, WM_AGENT_ACTIVATE, 0, 0, SMTO_ABORTIFHUNG | SMTO_BLOCK, AGENT_SIGNAL_TIMEOUT_MS, &result)) {
+            LogDebug(L"Keyboard agent did not respond (Error: %d).", GetLastError());
+            return false;
+        }
+        return result == 1;
+    }
+
+    void StartTouchKeyboard() {
+        if (SignalAgent()) {
+            LogDebug(L"Keyboard agent is resident. Activation delegated.");
+            return;
+        }
+
+        LogDebug(L"--- StartTouchKeyboard() [Mode: Prepare || Wait Shell -> Launch -> Wait -> Hide] ---");
+
+        StageTimer timer;
 
+        // Stage 1 (background): path resolution and file checks do not depend on the shell.
+        auto tabTipPathTask = std::async(std::launch::async, ResolveTabTipPath);
+
+        ReadinessWaiter waiter;
+        KeyboardSession session;
+        bool comInitialized = false;
+
+        auto releaseResources = [&]() {
+            session.Reset();
             if (comInitialized) {
                 LogDebug(L"CoUninitialize.");
                 CoUninitialize();
+                comInitialized = false;
             }
+        };
+
+        try {
+            // Stage 2 (foreground, overlaps stage 1): COM apartment and a warm FrameworkInputPane.
+            LogDebug(L"Initializing COM for visibility polling and control...");
+            HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+            if (SUCCEEDED(hr)) {
+                comInitialized = true;
+            }
+
+            if (!session.InputPane()) {
+                LogDebug(L"Warning: FrameworkInputPane pre-creation failed. Will retry per check.");
+            }
+            timer.Mark(L"COM apartment + FrameworkInputPane");
+
+            // Stages 3-4: shell-dependent launch, then wait for the keyboard and hide it.
+            RunKeyboardSequence(waiter, session, timer, [&]() { return tabTipPathTask.get(); });
+
+            releaseResources();
         }
         catch (const _com_error& e) {
-            if (comInitialized) CoUninitialize();
+            releaseResources();
             throw TabTipActivationException(WstringToString(e.ErrorMessage()));
         }
+        catch (const TabTipNotFoundException& e) {
+            UNREFERENCED_PARAMETER(e);
+            releaseResources();
+            throw;
+        }
         catch (const TabTipActivationException& e) {
             UNREFERENCED_PARAMETER(e);
-            if (comInitialized) CoUninitialize();
+            releaseResources();
             throw;
         }
         catch (...) {
             LogDebug(L"Critical: Unknown EXCEPTION caught.");
-            if (comInitialized) CoUninitialize();
+            releaseResources();
             throw;
         }
 
         LogDebug(L"--- StartTouchKeyboard() Finished ---");
     }
+
+    // Resident per-session keyboard host. Keeps the COM apartment, the input pane proxy and the
+    // resolved TabTip path warm, and re-runs the keyboard sequence when another startkeyboard invocation
+    // asks for it. A shell restart, session unlock or TabTip exit only makes sure TabTip is running.
+    class KeyboardAgent {
+    public:
+        ~KeyboardAgent() {
+            m_session.Reset();
+            if (m_hTabTip) CloseHandle(m_hTabTip);
+            if (m_hwnd) {
+                WTSUnRegisterSessionNotification(m_hwnd);
+                DestroyWindow(m_hwnd);
+            }
+        }
+
+        bool Create() {
+            m_taskbarCreatedMsg = RegisterWindowMessageW(L"TaskbarCreated");
+
+            HINSTANCE hInstance = GetModuleHandleW(NULL);
+            WNDCLASSEXW wc = { sizeof(wc) };
+            wc.lpfnWndProc = WndProc;
+            wc.hInstance = hInstance;
+            wc.lpszClassName = AGENT_WINDOW_CLASS;
+            if (!RegisterClassExW(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+                LogDebug(L"KeyboardAgent: RegisterClassExW failed (Error: %d).", GetLastError());
+                return false;
+            }
+
+            // A hidden top-level window (not message-only) so the TaskbarCreated broadcast reaches us.
+            m_hwnd = CreateWindowExW(WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE, AGENT_WINDOW_CLASS, L"", WS_POPUP,
+                0, 0, 0, 0, NULL, NULL, hInstance, this);
+            if (!m_hwnd) {
+                LogDebug(L"KeyboardAgent: CreateWindowExW failed (Error: %d).", GetLastError());
+                return false;
+            }
+
+            ChangeWindowMessageFilterEx(m_hwnd, WM_AGENT_ACTIVATE, MSGFLT_ALLOW, NULL);
+            if (m_taskbarCreatedMsg) ChangeWindowMessageFilterEx(m_hwnd, m_taskbarCreatedMsg, MSGFLT_ALLOW, NULL);
+
+            if (!WTSRegisterSessionNotification(m_hwnd, NOTIFY_FOR_THIS_SESSION)) {
+                LogDebug(L"KeyboardAgent: WTSRegisterSessionNotification failed (Error: %d). Unlock events disabled.", GetLastError());
+            }
+
+            if (!m_session.InputPane()) {
+                LogDebug(L"KeyboardAgent: FrameworkInputPane pre-creation failed. Will retry per activation.");
+            }
+            return true;
+        }
+
+        void Run() {
+            LogDebug(L"KeyboardAgent: Entering message loop...");
+            m_activationPending = true;
+            m_fullActivation = true;
+
+            while (m_running) {
+                DWORD timeoutMs = INFINITE;
+                if (m_activationPending) {
+                    auto sinceLast = std::chrono::steady_clock::now() - m_lastActivation;
+                    if (m_lastActivation.time_since_epoch().count() == 0 || sinceLast >= AGENT_RELAUNCH_COOLDOWN) {
+                        bool ensureOnly = !m_fullActivation;
+                        m_activationPending = false;
+                        m_fullActivation = false;
+                        Activate(ensureOnly);
+                        continue;
+                    }
+                    timeoutMs = (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(AGENT_RELAUNCH_COOLDOWN - sinceLast).count();
+                }
+
+                DWORD handleCount = m_hTabTip ? 1 : 0;
+                DWORD waitResult = MsgWaitForMultipleObjects(handleCount, m_hTabTip ? &m_hTabTip : NULL, FALSE, timeoutMs, QS_ALLINPUT);
+
+                if (handleCount && waitResult == WAIT_OBJECT_0) {
+                    LogDebug(L"KeyboardAgent: TabTip.exe exited. Scheduling relaunch.");
+                    CloseHandle(m_hTabTip);
+                    m_hTabTip = NULL;
+                    m_session.ReleaseTip();
+                    m_activationPending = true;
+                }
+                else if (waitResult == WAIT_OBJECT_0 + handleCount) {
+                    MSG msg;
+                    while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+                        if (msg.message == WM_QUIT) {
+                            LogDebug(L"KeyboardAgent: WM_QUIT received. Shutting down.");
+                            m_running = false;
+                            break;
+                        }
+                        TranslateMessage(&msg);
+                        DispatchMessageW(&msg);
+                    }
+                }
+                else if (waitResult == WAIT_FAILED) {
+                    LogDebug(L"KeyboardAgent: MsgWaitForMultipleObjects failed (Error: %d).", GetLastError());
+                    m_running = false;
+                }
+            }
+            LogDebug(L"KeyboardAgent: Exiting message loop.");
+        }
+
+    private:
+        void Activate(bool ensureOnly) {
+            LogDebug(L"--- KeyboardAgent Activation (%s) ---", ensureOnly ? L"ensure" : L"full");
+            m_lastActivation = std::chrono::steady_clock::now();
+
+            // The WinEvent hook only lives for the duration of an activation so the idle agent is not woken by
+            // every window created on the desktop.
+            ReadinessWaiter waiter;
+            StageTimer timer;
+            try {
+                RunKeyboardSequence(waiter, m_session, timer, [this]() {
+                    if (m_tabTipPath.empty()) m_tabTipPath = ResolveTabTipPath();
+                    return m_tabTipPath;
+                }, ensureOnly);
+            }
+            catch (const _com_error& e) {
+                UNREFERENCED_PARAMETER(e);
+                LogDebug(L"KeyboardAgent: COM error during activation.");
+            }
+            catch (const std::exception& e) {
+                UNREFERENCED_PARAMETER(e);
+                LogDebug(L"KeyboardAgent: Activation failed.");
+            }
+
+            if (waiter.QuitSeen()) {
+                LogDebug(L"KeyboardAgent: WM_QUIT received during activation. Shutting down.");
+                m_running = false;
+                return;
+            }
+            WatchTabTip();
+        }
+
+        void WatchTabTip() {
+            if (m_hTabTip) return;
+
+            DWORD pid = 0;
+            HWND hTabTipWnd = FindWindowW(TABTIP_WINDOW_CLASS, NULL);
+            if (hTabTipWnd) GetWindowThreadProcessId(hTabTipWnd, &pid);
+            if (!pid) pid = FindProcessId(TABTIP_PROCESS_NAME);
+            if (!pid) return;
+
+            m_hTabTip = OpenProcess(SYNCHRONIZE, FALSE, pid);
+            if (m_hTabTip) {
+                LogDebug(L"KeyboardAgent: Watching TabTip.exe (PID: %d).", pid);
+            }
+        }
+
+        static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+            if (msg == WM_NCCREATE) {
+                auto pCreate = reinterpret_cast<CREATESTRUCTW*>(lParam);
+                SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pCreate->lpCreateParams));
+            }
+
+            auto pAgent = reinterpret_cast<KeyboardAgent*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+            if (pAgent) {
+                if (msg == WM_AGENT_ACTIVATE) {
+                    LogDebug(L"KeyboardAgent: Activation requested.");
+                    pAgent->m_activationPending = true;
+                    pAgent->m_fullActivation = true;
+                    return 1;
+                }
+                if (pAgent->m_taskbarCreatedMsg && msg == pAgent->m_taskbarCreatedMsg) {
+                    LogDebug(L"KeyboardAgent: Shell restarted (TaskbarCreated).");
+                    pAgent->m_activationPending = true;
+                    return 0;
+                }
+                if (msg == WM_WTSSESSION_CHANGE && wParam == WTS_SESSION_UNLOCK) {
+                    LogDebug(L"KeyboardAgent: Session unlocked.");
+                    pAgent->m_activationPending = true;
+                    return 0;
+                }
+                if (msg == WM_ENDSESSION && wParam) {
+                    pAgent->m_running = false;
+                    return 0;
+                }
+            }
+            if (msg == WM_CLOSE) {
+                PostQuitMessage(0);
+                return 0;
+            }
+            return DefWindowProcW(hwnd, msg, wParam, lParam);
+        }
+
+        HWND m_hwnd = NULL;
+        HANDLE m_hTabTip = NULL;
+        UINT m_taskbarCreatedMsg = 0;
+        bool m_running = true;
+        bool m_activationPending = false;
+        bool m_fullActivation = false;
+        std::chrono::steady_clock::time_point m_lastActivation{};
+        std::wstring m_tabTipPath;
+        KeyboardSession m_session;
+    };
+
+    int RunAgent() {
+        LogDebug(L"--- RunAgent() Started ---");
+
+        HANDLE hAgentMutex = CreateMutexW(NULL, TRUE, AGENT_MUTEX_NAME);
+        if (hAgentMutex == NULL) {
+            LogDebug(L"Error: CreateMutexW failed (Error: %d). Aborting.", GetLastError());
+            return 1;
+        }
+        if (GetLastError() == ERROR_ALREADY_EXISTS) {
+            LogDebug(L"Keyboard agent already running. Exiting.");
+            CloseHandle(hAgentMutex);
+            return 0;
+        }
+
+        bool comInitialized = SUCCEEDED(CoInitializeEx(NULL, COINIT_APARTMENTTHREADED));
+        int result = 0;
+        {
+            KeyboardAgent agent;
+            if (agent.Create()) {
+                agent.Run();
+            }
+            else {
+                result = 1;
+            }
+        }
+        if (comInitialized) CoUninitialize();
+
+        ReleaseMutex(hAgentMutex);
+        CloseHandle(hAgentMutex);
+        LogDebug(L"--- RunAgent() Ended ---");
+        return result;
+    }
 }
\ No newline at end of file
@@ -16,6 +16,8 @@
 
 #pragma once
 #include "pch.h"
+#include <stdexcept>
+#include <string>
 
 class TabTipNotFoundException : public std::runtime_error {
 public:
@@ -29,4 +31,6 @@ public:
 
 namespace KeyboardManager {
     void StartTouchKeyboard();
+
+    int RunAgent();
 }
\ No newline at end of file
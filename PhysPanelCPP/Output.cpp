@@ -0,0 +1,234 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "Output.h"
+#include <io.h>
+#include <fcntl.h>
+#include <cstdarg>
+
+namespace Output {
+
+    bool g_jsonMode = false;
+    bool g_quietMode = false;
+    bool g_consoleAllowed = true;
+    bool g_outputReady = false;
+    INIT_ONCE g_consoleOnce = INIT_ONCE_STATIC_INIT;
+
+    void SetJsonMode(bool enabled) {
+        g_jsonMode = enabled;
+    }
+
+    bool IsJsonMode() {
+        return g_jsonMode;
+    }
+
+    void SetQuietMode(bool enabled) {
+        g_quietMode = enabled;
+    }
+
+    void SetConsoleAllowed(bool allowed) {
+        g_consoleAllowed = allowed;
+    }
+
+    // A caller that redirected the standard handle to a pipe or file (Process.RedirectStandardOutput,
+    // '> out.json') gets the output there as UTF-8 instead of on a console.
+    bool BindRedirectedStream(DWORD stdHandle, FILE* stream) {
+        HANDLE hStd = GetStdHandle(stdHandle);
+        if (hStd == NULL || hStd == INVALID_HANDLE_VALUE) return false;
+
+        DWORD type = GetFileType(hStd);
+        if (type != FILE_TYPE_PIPE && type != FILE_TYPE_DISK) return false;
+
+        // The CRT usually binds inherited handles at startup already; rebinding would close hStd.
+        if (_fileno(stream) >= 0 && reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(stream))) == hStd) {
+            (void)_setmode(_fileno(stream), _O_U8TEXT);
+            return true;
+        }
+
+        // The descriptor owns hStd for the life of the process; it is never closed.
+        int fd = _open_osfhandle(reinterpret_cast<intptr_t>(hStd), _O_WRONLY | _O_BINARY);
+        if (fd < 0) return false;
+
+        // GUI-subsystem processes may start without a CRT stream behind stdout/stderr.
+        FILE* fp = nullptr;
+        if (_fileno(stream) < 0) freopen_s(&fp, "NUL", "w", stream);
+        if (_fileno(stream) < 0 || _dup2(fd, _fileno(stream)) != 0) return false;
+
+        (void)_setmode(_fileno(stream), _O_U8TEXT);
+        return true;
+    }
+
+    BOOL CALLBACK AttachConsoleAndRedirectIO(PINIT_ONCE, PVOID, PVOID*) {
+        bool stdoutRedirected = BindRedirectedStream(STD_OUTPUT_HANDLE, stdout);
+        bool stderrRedirected = BindRedirectedStream(STD_ERROR_HANDLE, stderr);
+        if (stdoutRedirected && stderrRedirected) {
+            g_outputReady = true;
+            return TRUE;
+        }
+
+        // ERROR_ACCESS_DENIED: already attached, e.g. started with CREATE_NO_WINDOW. Its console is usable as is.
+        if (!AttachConsole(ATTACH_PARENT_PROCESS) && GetLastError() != ERROR_ACCESS_DENIED && !AllocConsole()) {
+            g_outputReady = stdoutRedirected;
+            return TRUE;
+        }
+
+        FILE* fp = nullptr;
+        if (!stdoutRedirected) {
+            freopen_s(&fp, "CONOUT$", "w", stdout);
+            (void)_setmode(_fileno(stdout), _O_WTEXT);
+        }
+        if (!stderrRedirected) {
+            freopen_s(&fp, "CONOUT$", "w", stderr);
+            (void)_setmode(_fileno(stderr), _O_WTEXT);
+        }
+
+        g_outputReady = true;
+        return TRUE;
+    }
+
+    bool EnsureConsole() {
+        if (g_quietMode || !g_consoleAllowed) return false;
+
+        InitOnceExecuteOnce(&g_consoleOnce, AttachConsoleAndRedirectIO, nullptr, nullptr);
+        return g_outputReady;
+    }
+
+    void Print(const wchar_t* format, ...) {
+        if (!EnsureConsole()) return;
+
+        va_list args;
+        va_start(args, format);
+        vfwprintf(stdout, format, args);
+        va_end(args);
+    }
+
+    void PrintError(const wchar_t* format, ...) {
+        if (!EnsureConsole()) return;
+
+        va_list args;
+        va_start(args, format);
+        vfwprintf(stderr, format, args);
+        va_end(args);
+    }
+
+    void JsonObject::AppendKey(const wchar_t* key) {
+        if (!m_body.empty()) m_body += L',';
+        AppendEscaped(key);
+        m_body += L':';
+    }
+
+    void JsonObject::AppendEscaped(const wchar_t* value) {
+        m_body += L'"';
+        for (const wchar_t* p = value; *p; ++p) {
+            switch (*p) {
+            case L'"': m_body += L"\\\""; break;
+            case L'\\': m_body += L"\\\\"; break;
+            case L'\n': m_body += L"\\n"; break;
+            case L'\r': m_body += L"\\r"; break;
+            case L'\t': m_body += L"\\t"; break;
+            default:
+                if (*p < 0x20) {
+                    wchar_t escape[8];
+                    swprintf_s(escape, L"\\u%04X", (unsigned)*p);
+                    m_body += escape;
+                }
+                else {
+                    m_body += *p;
+                }
+            }
+        }
+        m_body += L'"';
+    }
+
+    JsonObject& JsonObject::AddString(const wchar_t* key, const wchar_t* value) {
+        AppendKey(key);
+        AppendEscaped(value ? value : L"");
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddBool(const wchar_t* key, bool value) {
+        AppendKey(key);
+        m_body += value ? L"true" : L"false";
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddInt(const wchar_t* key, long long value) {
+        AppendKey(key);
+        m_body += std::to_wstring(value);
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddUInt(const wchar_t* key, unsigned long long value) {
+        AppendKey(key);
+        m_body += std::to_wstring(value);
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddDouble(const wchar_t* key, double value) {
+        AppendKey(key);
+        // wmain adopts the user's locale, whose decimal separator may be ','. JSON always needs '.'.
+        static const _locale_t cLocale = _create_locale(LC_NUMERIC, "C");
+        wchar_t buffer[32];
+        if (cLocale) _swprintf_s_l(buffer, _countof(buffer), L"%.2f", cLocale, value);
+        else swprintf_s(buffer, L"%.2f", value);
+        for (wchar_t* p = buffer; *p; ++p) {
+            if (*p == L',') *p = L'.';
+        }
+        m_body += buffer;
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddNtStatus(const wchar_t* key, NTSTATUS status) {
+        wchar_t buffer[16];
+        swprintf_s(buffer, L"0x%08X", (ULONG)status);
+        return AddString(key, buffer);
+    }
+
+    JsonObject& JsonObject::AddObject(const wchar_t* key, const JsonObject& value) {
+        AppendKey(key);
+        m_body += value.ToString();
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddArray(const wchar_t* key, const std::vector<JsonObject>& values) {
+        AppendKey(key);
+        m_body += L'[';
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i) m_body += L',';
+            m_body += values[i].ToString();
+        }
+        m_body += L']';
+        return *this;
+    }
+
+    JsonObject& JsonObject::AddNull(const wchar_t* key) {
+        AppendKey(key);
+        m_body += L"null";
+        return *this;
+    }
+
+    std::wstring JsonObject::ToString() const {
+        return L"{" + m_body + L"}";
+    }
+
+    void JsonObject::Print() const {
+        if (!EnsureConsole()) return;
+
+        wprintf(L"%s\n", ToString().c_str());
+        fflush(stdout);
+    }
+}
\ No newline at end of file
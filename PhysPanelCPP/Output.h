@@ -0,0 +1,68 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+#include <string>
+#include <vector>
+
+namespace Output {
+
+    // Selected once in wmain from the --json switch.
+    void SetJsonMode(bool enabled);
+
+    bool IsJsonMode();
+
+    // --quiet: suppress all console output; callers rely on the exit code only.
+    void SetQuietMode(bool enabled);
+
+    // Headless commands disallow the console entirely, so nothing is ever attached or allocated.
+    void SetConsoleAllowed(bool allowed);
+
+    // On first use, writes to stdout/stderr where the caller redirected them (pipe or file); otherwise
+    // attaches to the parent console (or allocates one) and redirects them there. Deferred until the
+    // first write so invocations that print nothing never create a console.
+    bool EnsureConsole();
+
+    void Print(const wchar_t* format, ...);
+
+    void PrintError(const wchar_t* format, ...);
+
+    // Flat JSON object builder. Each object is printed on its own line (JSON Lines),
+    // so batch output stays streamable and trivially splittable by callers.
+    class JsonObject {
+    public:
+        JsonObject& AddString(const wchar_t* key, const wchar_t* value);
+        JsonObject& AddBool(const wchar_t* key, bool value);
+        JsonObject& AddInt(const wchar_t* key, long long value);
+        JsonObject& AddUInt(const wchar_t* key, unsigned long long value);
+        JsonObject& AddDouble(const wchar_t* key, double value);
+        JsonObject& AddNtStatus(const wchar_t* key, NTSTATUS status);
+        JsonObject& AddObject(const wchar_t* key, const JsonObject& value);
+        JsonObject& AddArray(const wchar_t* key, const std::vector<JsonObject>& values);
+        JsonObject& AddNull(const wchar_t* key);
+
+        std::wstring ToString() const;
+
+        void Print() const;
+
+    private:
+        void AppendKey(const wchar_t* key);
+        void AppendEscaped(const wchar_t* value);
+
+        std::wstring m_body;
+    };
+}
\ No newline at end of file
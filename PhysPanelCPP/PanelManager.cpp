@@ -16,6 +16,10 @@
 
 #include "pch.h"
 #include "PanelManager.h"
+#include "Utils.h"
+#include <cerrno>
+#include <climits>
+#include <cwctype>
 
 typedef const struct _WNF_STATE_NAME* PCWNF_STATE_NAME;
 
@@ -45,14 +49,37 @@ extern "C" {
         _In_ ULONG CheckStamp);
 }
 
+typedef NTSTATUS(NTAPI* PWNF_USER_CALLBACK)(
+    _In_ WNF_STATE_NAME StateName,
+    _In_ ULONG ChangeStamp,
+    _In_opt_ PCWNF_TYPE_ID TypeId,
+    _In_opt_ PVOID CallbackContext,
+    _In_reads_bytes_opt_(Length) const VOID* Buffer,
+    _In_ ULONG Length);
+
+typedef NTSTATUS(NTAPI* PRtlSubscribeWnfStateChangeNotification)(
+    _Outptr_ PVOID* SubscriptionHandle,
+    _In_ WNF_STATE_NAME StateName,
+    _In_ ULONG ChangeStamp,
+    _In_ PWNF_USER_CALLBACK Callback,
+    _In_opt_ PVOID CallbackContext,
+    _In_opt_ PCWNF_TYPE_ID TypeId,
+    _In_opt_ ULONG SerializationGroup,
+    _Reserved_ ULONG Unknown);
+
+typedef NTSTATUS(NTAPI* PRtlUnsubscribeWnfStateChangeNotification)(
+    _In_ PVOID SubscriptionHandle);
+
 namespace PanelManager {
 
     const WNF_STATE_NAME WNF_DX_INTERNAL_PANEL_DIMENSIONS = { 0xA3BC4875, 0x41C61629 };
 
-    std::optional<Dimensions> GetDisplaySize() {
+    const int APPLY_MAX_ATTEMPTS = 3;
+
+    NTSTATUS QueryDisplayState(PanelState& state) {
         ULONG bufferSize = sizeof(ULONGLONG);
         ULONGLONG rawDimensions = 0;
-        ULONG changeStamp;
+        ULONG changeStamp = 0;
 
         NTSTATUS status = NtQueryWnfStateData(
             &WNF_DX_INTERNAL_PANEL_DIMENSIONS,
@@ -63,11 +90,17 @@ namespace PanelManager {
             &bufferSize
         );
 
-        if (status == 0 && bufferSize == sizeof(ULONGLONG)) {
-            Dimensions dims;
-            dims.WidthMm = (UINT)(rawDimensions & 0xFFFFFFFF);
-            dims.HeightMm = (UINT)((rawDimensions >> 32) & 0xFFFFFFFF);
-            return dims;
+        state.ChangeStamp = changeStamp;
+        state.HasData = (status == 0 && bufferSize == sizeof(ULONGLONG));
+        state.Dims.WidthMm = state.HasData ? (UINT)(rawDimensions & 0xFFFFFFFF) : 0;
+        state.Dims.HeightMm = state.HasData ? (UINT)((rawDimensions >> 32) & 0xFFFFFFFF) : 0;
+        return status;
+    }
+
+    std::optional<Dimensions> GetDisplaySize() {
+        PanelState state;
+        if (QueryDisplayState(state) == 0 && state.HasData) {
+            return state.Dims;
         }
 
         return std::nullopt;
@@ -87,13 +120,83 @@ namespace PanelManager {
         );
     }
 
-    bool SetOEMDeviceForm() {
+    bool ParseDimension(const wchar_t* arg, UINT& value) {
+        if (!arg || !iswdigit(arg[0])) return false;
+
+        wchar_t* endPtr = nullptr;
+        errno = 0;
+        unsigned long parsed = wcstoul(arg, &endPtr, 10);
+        if (*endPtr != L'\0' || errno == ERANGE || parsed == 0 || parsed > UINT_MAX) return false;
+
+        value = static_cast<UINT>(parsed);
+        return true;
+    }
+
+    bool ParseDimensions(const wchar_t* widthArg, const wchar_t* heightArg, Dimensions& dims) {
+        Dimensions parsed;
+        if (!ParseDimension(widthArg, parsed.WidthMm) || !ParseDimension(heightArg, parsed.HeightMm)) return false;
+
+        dims = parsed;
+        return true;
+    }
+
+    NTSTATUS ApplyDisplaySize(const Dimensions& dims, bool* changed) {
+        if (changed) *changed = false;
+
+        ULONGLONG dimensions = ((ULONGLONG)dims.HeightMm << 32) | dims.WidthMm;
+        NTSTATUS status = 0;
+
+        for (int attempt = 0; attempt < APPLY_MAX_ATTEMPTS; ++attempt) {
+            PanelState state;
+            if (QueryDisplayState(state) != 0) {
+                // Cannot read the current value: fall back to the unconditional write.
+                status = SetDisplaySize(dims);
+                if (status == 0 && changed) *changed = true;
+                return status;
+            }
+
+            if (state.HasData && state.Dims.WidthMm == dims.WidthMm && state.Dims.HeightMm == dims.HeightMm) {
+                return 0;
+            }
+
+            status = NtUpdateWnfStateData(
+                &WNF_DX_INTERNAL_PANEL_DIMENSIONS,
+                &dimensions,
+                sizeof(dimensions),
+                nullptr,
+                nullptr,
+                state.ChangeStamp,
+                TRUE
+            );
+            if (status == 0) {
+                if (changed) *changed = true;
+                return 0;
+            }
+
+            // Only retry when someone else published in between; any other failure is final.
+            PanelState after;
+            if (QueryDisplayState(after) != 0 || after.ChangeStamp == state.ChangeStamp) {
+                return status;
+            }
+        }
+
+        return status;
+    }
+
+    bool SetOEMDeviceForm(bool* changed) {
+        if (changed) *changed = false;
+
+        // Skip the write (and the hive log entry plus key notifications it causes) when already set.
+        DWORD current = 0;
+        if (GetOEMDeviceForm(current) && current == OEM_DEVICE_FORM_VALUE) {
+            return true;
+        }
+
         HKEY hKey;
-        LPCWSTR subKey = L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\OEM";
 
         LONG lRes = RegCreateKeyExW(
             HKEY_LOCAL_MACHINE,
-            subKey,
+            OEM_REGISTRY_SUBKEY,
             0,
             NULL,
             REG_OPTION_NON_VOLATILE,
@@ -107,7 +210,7 @@ namespace PanelManager {
             return false;
         }
 
-        DWORD data = 0x0000002e;
+        DWORD data = OEM_DEVICE_FORM_VALUE;
         lRes = RegSetValueExW(
             hKey,
             L"DeviceForm",
@@ -118,6 +221,245 @@ namespace PanelManager {
         );
 
         RegCloseKey(hKey);
+        if (lRes == ERROR_SUCCESS && changed) *changed = true;
         return (lRes == ERROR_SUCCESS);
     }
+
+    bool GetOEMDeviceForm(DWORD& value) {
+        DWORD size = sizeof(value);
+        return RegGetValueW(HKEY_LOCAL_MACHINE, OEM_REGISTRY_SUBKEY, L"DeviceForm", RRF_RT_REG_DWORD,
+            NULL, &value, &size) == ERROR_SUCCESS;
+    }
+
+    const NTSTATUS WNF_STATUS_NOT_FOUND = (NTSTATUS)0xC0000225L; // STATUS_NOT_FOUND
+
+    NTSTATUS SubscribeDisplaySizeChanges(ULONG changeStamp, PWNF_USER_CALLBACK callback, PVOID context, PVOID* subscription) {
+        HMODULE hNtdll = GetModuleHandleW(L"ntdll.dll");
+        auto RtlSubscribeWnfStateChangeNotification = hNtdll
+            ? (PRtlSubscribeWnfStateChangeNotification)GetProcAddress(hNtdll, "RtlSubscribeWnfStateChangeNotification")
+            : nullptr;
+        if (!RtlSubscribeWnfStateChangeNotification) {
+            return WNF_STATUS_NOT_FOUND;
+        }
+
+        return RtlSubscribeWnfStateChangeNotification(subscription, WNF_DX_INTERNAL_PANEL_DIMENSIONS, changeStamp,
+            callback, context, nullptr, 0, 0);
+    }
+
+    void UnsubscribeDisplaySizeChanges(PVOID subscription) {
+        HMODULE hNtdll = GetModuleHandleW(L"ntdll.dll");
+        auto RtlUnsubscribeWnfStateChangeNotification = hNtdll
+            ? (PRtlUnsubscribeWnfStateChangeNotification)GetProcAddress(hNtdll, "RtlUnsubscribeWnfStateChangeNotification")
+            : nullptr;
+        if (RtlUnsubscribeWnfStateChangeNotification) {
+            RtlUnsubscribeWnfStateChangeNotification(subscription);
+        }
+    }
+
+    const ULONGLONG WATCHDOG_WINDOW_MS = 10000;
+    const ULONG WATCHDOG_MAX_REWRITES_PER_WINDOW = 5;
+
+    struct WatchdogCallbacks {
+        static NTSTATUS NTAPI OnStateChanged(WNF_STATE_NAME, ULONG changeStamp, PCWNF_TYPE_ID, PVOID context,
+            const VOID* buffer, ULONG bufferSize) {
+            static_cast<DisplaySizeWatchdog*>(context)->HandleStateChange(changeStamp, buffer, bufferSize);
+            return 0;
+        }
+
+        static VOID CALLBACK OnRecheckTimer(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER) {
+            static_cast<DisplaySizeWatchdog*>(context)->Recheck();
+        }
+    };
+
+    NTSTATUS DisplaySizeWatchdog::Start(const Dimensions& target) {
+        Stop();
+        m_target = target;
+        m_recheckTimer = CreateThreadpoolTimer(WatchdogCallbacks::OnRecheckTimer, this, NULL);
+        if (!m_recheckTimer) LogDebug(L"Watchdog: CreateThreadpoolTimer failed (Error: %d). Skipped publishes wait for the next one.", GetLastError());
+
+        // ChangeStamp 0 delivers the current state only when one has been published; at boot there usually is
+        // none yet, so callers must write the override themselves once subscribed.
+        return SubscribeDisplaySizeChanges(0, WatchdogCallbacks::OnStateChanged, this, &m_subscription);
+    }
+
+    void DisplaySizeWatchdog::Stop() {
+        if (m_subscription) {
+            UnsubscribeDisplaySizeChanges(m_subscription);
+            m_subscription = nullptr;
+        }
+        // Unsubscribed first, so nothing re-arms the timer while it is cancelled.
+        if (m_recheckTimer) {
+            SetThreadpoolTimer(m_recheckTimer, NULL, 0, 0);
+            WaitForThreadpoolTimerCallbacks(m_recheckTimer, TRUE);
+            CloseThreadpoolTimer(m_recheckTimer);
+            m_recheckTimer = nullptr;
+        }
+        m_recheckArmed = 0;
+    }
+
+    // Coalesced: one pending re-check covers every publish skipped in the same window.
+    void DisplaySizeWatchdog::ScheduleRecheck(ULONGLONG delayMs) {
+        if (!m_recheckTimer || InterlockedCompareExchange(&m_recheckArmed, 1, 0) != 0) return;
+
+        ULARGE_INTEGER due;
+        due.QuadPart = (ULONGLONG)(-(LONGLONG)(delayMs * 10000));
+        FILETIME dueTime = { due.LowPart, due.HighPart };
+        SetThreadpoolTimer(m_recheckTimer, &dueTime, 0, 0);
+    }
+
+    void DisplaySizeWatchdog::Recheck() {
+        InterlockedExchange(&m_recheckArmed, 0);
+
+        // Read-compare-write: a no-op when the last publish already matched the override.
+        bool changed = false;
+        NTSTATUS status = ApplyDisplaySize(m_target, &changed);
+        LogDebug(L"Watchdog: Deferred re-check after budget window (NTSTATUS 0x%X, changed: %d).", status, changed);
+        if (status == 0 && changed) {
+            InterlockedIncrement(&m_rewriteCount);
+        }
+    }
+
+    void DisplaySizeWatchdog::HandleStateChange(ULONG changeStamp, const VOID* buffer, ULONG bufferSize) {
+        if (buffer && bufferSize == sizeof(ULONGLONG)) {
+            ULONGLONG raw = *static_cast<const ULONGLONG*>(buffer);
+            if ((UINT)(raw & 0xFFFFFFFF) == m_target.WidthMm && (UINT)((raw >> 32) & 0xFFFFFFFF) == m_target.HeightMm) {
+                LogDebug(L"Watchdog: Stamp %u matches override %u x %u mm.", changeStamp, m_target.WidthMm, m_target.HeightMm);
+                return;
+            }
+        }
+
+        // Guard against a ping-pong with another writer that keeps reasserting its own value.
+        ULONGLONG now = GetTickCount64();
+        if (now - m_windowStart >= WATCHDOG_WINDOW_MS) {
+            m_windowStart = now;
+            m_windowRewrites = 0;
+        }
+        if (m_windowRewrites >= WATCHDOG_MAX_REWRITES_PER_WINDOW) {
+            LogDebug(L"Watchdog: Rewrite budget exhausted for this window. Deferring stamp %u.", changeStamp);
+            ScheduleRecheck(m_windowStart + WATCHDOG_WINDOW_MS - now);
+            return;
+        }
+        m_windowRewrites++;
+
+        bool changed = false;
+        NTSTATUS status = ApplyDisplaySize(m_target, &changed);
+        LogDebug(L"Watchdog: Stamp %u clobbered the override. Rewrite NTSTATUS: 0x%X", changeStamp, status);
+        if (status == 0 && changed) {
+            InterlockedIncrement(&m_rewriteCount);
+        }
+    }
+
+    bool DeviceFormGuard::Start() {
+        Stop();
+
+        LONG lRes = RegCreateKeyExW(HKEY_LOCAL_MACHINE, OEM_REGISTRY_SUBKEY, 0, NULL, REG_OPTION_NON_VOLATILE,
+            KEY_NOTIFY, NULL, &m_hKey, NULL);
+        if (lRes != ERROR_SUCCESS) {
+            LogDebug(L"DeviceFormGuard: Failed to open OEM key (Error: %d).", lRes);
+            m_hKey = NULL;
+            return false;
+        }
+
+        m_hChangedEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        m_hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (m_hChangedEvent && m_hStopEvent) {
+            m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        }
+        if (!m_hThread) {
+            LogDebug(L"DeviceFormGuard: Failed to start (Error: %d).", GetLastError());
+            Stop();
+            return false;
+        }
+        return true;
+    }
+
+    void DeviceFormGuard::Stop() {
+        if (m_hThread) {
+            SetEvent(m_hStopEvent);
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            m_hThread = NULL;
+        }
+        if (m_hStopEvent) { CloseHandle(m_hStopEvent); m_hStopEvent = NULL; }
+        if (m_hChangedEvent) { CloseHandle(m_hChangedEvent); m_hChangedEvent = NULL; }
+        if (m_hKey) { RegCloseKey(m_hKey); m_hKey = NULL; }
+    }
+
+    DWORD WINAPI DeviceFormGuard::ThreadProc(LPVOID param) {
+        static_cast<DeviceFormGuard*>(param)->Run();
+        return 0;
+    }
+
+    void DeviceFormGuard::Run() {
+        ULONGLONG windowStart = 0;
+        ULONG windowRestores = 0;
+        bool armed = false;
+
+        while (true) {
+            // Async notifications are bound to the registering thread, so arm and wait here. A deferred
+            // re-check wakes with the notification still pending, so it is not registered twice.
+            if (!armed) {
+                LONG lRes = RegNotifyChangeKeyValue(m_hKey, FALSE, REG_NOTIFY_CHANGE_LAST_SET, m_hChangedEvent, TRUE);
+                if (lRes != ERROR_SUCCESS) {
+                    LogDebug(L"DeviceFormGuard: RegNotifyChangeKeyValue failed (Error: %d). Guard stopped.", lRes);
+                    return;
+                }
+                armed = true;
+            }
+
+            // Check after arming so a write in between is not missed. Our own restore re-triggers the
+            // notification once and then reads back as matching.
+            DWORD current = 0;
+            DWORD recheckMs = INFINITE;
+            if (!GetOEMDeviceForm(current) || current != OEM_DEVICE_FORM_VALUE) {
+                ULONGLONG now = GetTickCount64();
+                if (now - windowStart >= WATCHDOG_WINDOW_MS) {
+                    windowStart = now;
+                    windowRestores = 0;
+                }
+
+                if (windowRestores < WATCHDOG_MAX_REWRITES_PER_WINDOW) {
+                    windowRestores++;
+                    bool changed = false;
+                    bool success = SetOEMDeviceForm(&changed);
+                    LogDebug(L"DeviceFormGuard: DeviceForm was 0x%X. Restore %s.", current, success ? L"succeeded" : L"failed");
+                    if (success && changed) InterlockedIncrement(&m_restoreCount);
+                }
+                else {
+                    LogDebug(L"DeviceFormGuard: Restore budget exhausted for this window. Deferring the restore.");
+                    recheckMs = (DWORD)(windowStart + WATCHDOG_WINDOW_MS - now);
+                }
+            }
+
+            HANDLE handles[] = { m_hStopEvent, m_hChangedEvent };
+            DWORD waitResult = WaitForMultipleObjects(2, handles, FALSE, recheckMs);
+            if (waitResult == WAIT_OBJECT_0 + 1) {
+                armed = false;
+            }
+            else if (waitResult != WAIT_TIMEOUT) {
+                return;
+            }
+        }
+    }
+
+    NTSTATUS NTAPI OnDisplaySizePublished(WNF_STATE_NAME, ULONG, PCWNF_TYPE_ID, PVOID context, const VOID*, ULONG) {
+        SetEvent(static_cast<HANDLE>(context));
+        return 0;
+    }
+
+    NTSTATUS DisplaySizeChangeNotifier::Start(HANDLE hChangedEvent) {
+        Stop();
+
+        // Subscribe from the current stamp so only later publishes are delivered.
+        PanelState state;
+        QueryDisplayState(state);
+        return SubscribeDisplaySizeChanges(state.ChangeStamp, OnDisplaySizePublished, hChangedEvent, &m_subscription);
+    }
+
+    void DisplaySizeChangeNotifier::Stop() {
+        if (!m_subscription) return;
+
+        UnsubscribeDisplaySizeChanges(m_subscription);
+        m_subscription = nullptr;
+    }
 }
\ No newline at end of file
@@ -19,14 +19,126 @@
 
 namespace PanelManager {
 
+    constexpr auto OEM_REGISTRY_SUBKEY = L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\OEM";
+    const DWORD OEM_DEVICE_FORM_VALUE = 0x2e;
+
+    // Held by whichever resident mode (watch or the boot service) keeps the override asserted.
+    constexpr auto PANEL_WATCH_MUTEX_NAME = L"Global\\XFEST_PanelWatch_Lock";
+
     struct Dimensions {
         UINT WidthMm;
         UINT HeightMm;
     };
 
+    struct PanelState {
+        Dimensions Dims;
+        ULONG ChangeStamp;
+        bool HasData;
+    };
+
+    // Strictly parses decimal millimetre arguments received on the control pipe. Rejects signs,
+    // trailing characters, zero and out-of-range values.
+    bool ParseDimensions(const wchar_t* widthArg, const wchar_t* heightArg, Dimensions& dims);
+
     std::optional<Dimensions> GetDisplaySize();
 
+    // Reads the current override together with its WNF change stamp.
+    NTSTATUS QueryDisplayState(PanelState& state);
+
+    // Unconditional publish. Prefer ApplyDisplaySize, which skips redundant updates.
     NTSTATUS SetDisplaySize(const Dimensions& dims);
 
-    bool SetOEMDeviceForm();
+    // Read-compare-write: publishes only when the stored value differs, using the change stamp for
+    // optimistic concurrency. `changed` reports whether a new value was actually published.
+    NTSTATUS ApplyDisplaySize(const Dimensions& dims, bool* changed = nullptr);
+
+    // Writes DeviceForm = 0x2e only when the stored value differs. `changed` reports whether a write happened.
+    bool SetOEMDeviceForm(bool* changed = nullptr);
+
+    // Reads HKLM\...\OEM\DeviceForm. Returns false when the value is absent or not a DWORD.
+    bool GetOEMDeviceForm(DWORD& value);
+
+    // Keeps the panel dimension override asserted by subscribing to WNF_DX_INTERNAL_PANEL_DIMENSIONS
+    // and rewriting it whenever another component publishes a different value.
+    // Callbacks run on the ntdll WNF delivery thread. Start does not write the override; apply it once
+    // subscribed so nothing published in between is missed. A publish skipped because the rewrite budget
+    // ran out is re-checked once when the budget window ends.
+    class DisplaySizeWatchdog {
+    public:
+        DisplaySizeWatchdog() = default;
+        ~DisplaySizeWatchdog() { Stop(); }
+
+        DisplaySizeWatchdog(const DisplaySizeWatchdog&) = delete;
+        DisplaySizeWatchdog& operator=(const DisplaySizeWatchdog&) = delete;
+
+        NTSTATUS Start(const Dimensions& target);
+
+        void Stop();
+
+        ULONG RewriteCount() const { return m_rewriteCount; }
+
+    private:
+        friend struct WatchdogCallbacks;
+
+        void HandleStateChange(ULONG changeStamp, const VOID* buffer, ULONG bufferSize);
+
+        void ScheduleRecheck(ULONGLONG delayMs);
+
+        void Recheck();
+
+        Dimensions m_target = { 0, 0 };
+        PVOID m_subscription = nullptr;
+        PTP_TIMER m_recheckTimer = nullptr;
+        volatile LONG m_recheckArmed = 0;
+        volatile LONG m_rewriteCount = 0;
+        ULONGLONG m_windowStart = 0;
+        ULONG m_windowRewrites = 0;
+    };
+
+    // Restores DeviceForm whenever the OEM key is written (RegNotifyChangeKeyValue on a private
+    // thread), so resident modes react to resets instead of rewriting the value blindly. Like the
+    // watchdog, a reset skipped for budget is restored when the budget window ends.
+    class DeviceFormGuard {
+    public:
+        DeviceFormGuard() = default;
+        ~DeviceFormGuard() { Stop(); }
+
+        DeviceFormGuard(const DeviceFormGuard&) = delete;
+        DeviceFormGuard& operator=(const DeviceFormGuard&) = delete;
+
+        bool Start();
+
+        void Stop();
+
+        ULONG RestoreCount() const { return m_restoreCount; }
+
+    private:
+        static DWORD WINAPI ThreadProc(LPVOID param);
+
+        void Run();
+
+        HKEY m_hKey = NULL;
+        HANDLE m_hChangedEvent = NULL;
+        HANDLE m_hStopEvent = NULL;
+        HANDLE m_hThread = NULL;
+        volatile LONG m_restoreCount = 0;
+    };
+
+    // Signals an event each time a new value is published to WNF_DX_INTERNAL_PANEL_DIMENSIONS,
+    // for callers that only need to know the cached value is stale.
+    class DisplaySizeChangeNotifier {
+    public:
+        DisplaySizeChangeNotifier() = default;
+        ~DisplaySizeChangeNotifier() { Stop(); }
+
+        DisplaySizeChangeNotifier(const DisplaySizeChangeNotifier&) = delete;
+        DisplaySizeChangeNotifier& operator=(const DisplaySizeChangeNotifier&) = delete;
+
+        NTSTATUS Start(HANDLE hChangedEvent);
+
+        void Stop();
+
+    private:
+        PVOID m_subscription = nullptr;
+    };
 }
\ No newline at end of file
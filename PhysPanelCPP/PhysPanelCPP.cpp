@@ -19,116 +19,473 @@
 #include "KeyboardManager.h"
 #include "TouchManager.h"
 #include "Utils.h"
-#include <io.h>
-#include <fcntl.h>
+#include "Trace.h"
+#include "Output.h"
+#include "Bench.h"
+#include "StatusBlock.h"
+#include "PowerMonitor.h"
+#include "FeatureManager.h"
+#include "BootService.h"
+#include <string>
+#include <vector>
 
 void PrintUsage() {
     wchar_t version[32];
     GetAppVersion(version, 32);
 
-    wprintf(L"\n");
-    wprintf(L"Xbox Full Screen Experience Tool\n");
-    wprintf(L"PhysPanelCPP Utility v%s\n", version);
-    wprintf(L"Copyright (C) 2025 8bit2qubit\n");
-    wprintf(L"-----------------------------------------------------\n");
-    wprintf(L"Usage: PhysPanelCPP <command> [arguments...]\n\n");
-    wprintf(L"Commands:\n");
-    wprintf(L"  get                  Get the current physical display size (in mm and inches).\n");
-    wprintf(L"  set <w> <h> [opt]    Set display size (mm). Use 'reg' as 3rd arg to update OEM registry (0x2e).\n");
-    wprintf(L"                       Requires SYSTEM privileges.\n");
-    wprintf(L"  reg                  Set OEM DeviceForm registry key to 0x2e only. Requires SYSTEM privileges.\n");
-    wprintf(L"  startkeyboard        Launches and prepares the gamepad keyboard for use.\n");
-    wprintf(L"  touchservice         Simulates touch capabilities to enable gamepad keyboard input.\n\n");
-    wprintf(L"Examples:\n");
-    wprintf(L"  PhysPanelCPP get\n");
-    wprintf(L"  PhysPanelCPP set 155 87\n");
-    wprintf(L"  PhysPanelCPP set 155 87 reg\n");
-    wprintf(L"  PhysPanelCPP startkeyboard\n");
-    wprintf(L"  PhysPanelCPP touchservice\n\n");
+    Output::Print(L"\n");
+    Output::Print(L"Xbox Full Screen Experience Tool\n");
+    Output::Print(L"PhysPanelCPP Utility v%s\n", version);
+    Output::Print(L"Copyright (C) 2025 8bit2qubit\n");
+    Output::Print(L"-----------------------------------------------------\n");
+    Output::Print(L"Usage: PhysPanelCPP [--json] [--quiet] <command> [arguments...]\n\n");
+    Output::Print(L"Options:\n");
+    Output::Print(L"  --json               Print one JSON object per command (raw values, NTSTATUS, timings).\n");
+    Output::Print(L"  --quiet, -q          Print nothing and never attach a console; check the exit code.\n\n");
+    Output::Print(L"Commands:\n");
+    Output::Print(L"  get                  Get the current physical display size (in mm and inches).\n");
+    Output::Print(L"  set <w> <h> [opt]    Set display size (mm). Use 'reg' as 3rd arg to update OEM registry (0x2e).\n");
+    Output::Print(L"                       Requires SYSTEM privileges.\n");
+    Output::Print(L"  reg                  Set OEM DeviceForm registry key to 0x2e only. Requires SYSTEM privileges.\n");
+    Output::Print(L"  watch <w> <h> [opt]  Stay resident and reassert the display size whenever it is overwritten.\n");
+    Output::Print(L"                       Use 'reg' as 3rd arg to also keep the OEM registry key set. Requires SYSTEM privileges.\n");
+    Output::Print(L"  bootservice install <w> <h> [opt]\n");
+    Output::Print(L"                       Installs an early-start service that applies the display size before the shell\n");
+    Output::Print(L"                       loads and then keeps it asserted like 'watch'. Requires administrator rights.\n");
+    Output::Print(L"  bootservice uninstall\n");
+    Output::Print(L"                       Stops and removes the early-start service.\n");
+    Output::Print(L"  batch <cmds...>      Runs several get/set/reg commands in one process and reports each step.\n");
+    Output::Print(L"                       Use '-' to read commands from stdin, one or more per line.\n");
+    Output::Print(L"  bench [-n N] [suite] Times hot paths and prints p50/p95/p99 per suite as JSON.\n");
+    Output::Print(L"                       Default: wnf-query wnf-apply-noop mutex-probe status-read (skipped when unavailable).\n");
+    Output::Print(L"                       Opt-in: wnf-publish touch-inject keyboard worker-launch touch-probe json-pipe.\n");
+    Output::Print(L"                       Exits non-zero when a suite has no successful sample.\n");
+    Output::Print(L"  startkeyboard        Launches and prepares the gamepad keyboard for use.\n");
+    Output::Print(L"                       Delegates to a running keyboard agent when one is present.\n");
+    Output::Print(L"  keyboardagent        Stays resident and re-prepares the keyboard on shell restart, unlock or TabTip exit.\n");
+    Output::Print(L"                       Not started automatically; launch it per session (e.g. at logon) yourself.\n");
+    Output::Print(L"  touchservice         Simulates touch capabilities to enable gamepad keyboard input.\n");
+    Output::Print(L"                       --gamepad-touch: also turn controller input into touch (View+Menu toggles).\n");
+    Output::Print(L"  touchstatus          Prints the touch service status block (workers, desktops, panel size).\n");
+    Output::Print(L"  features query [type] <ids...>\n");
+    Output::Print(L"                       Queries feature IDs in one pass. Type: runtime (default) or boot.\n");
+    Output::Print(L"  features apply [type] <enable|disable|reset> <ids...> [...]\n");
+    Output::Print(L"                       Applies each action to its ID set in one call per type (default: runtime and boot).\n");
+    Output::Print(L"                       IDs may be space- or comma-separated. Requires administrator rights.\n\n");
+    Output::Print(L"Examples:\n");
+    Output::Print(L"  PhysPanelCPP get\n");
+    Output::Print(L"  PhysPanelCPP --json get\n");
+    Output::Print(L"  PhysPanelCPP set 155 87\n");
+    Output::Print(L"  PhysPanelCPP set 155 87 reg\n");
+    Output::Print(L"  PhysPanelCPP watch 155 87 reg\n");
+    Output::Print(L"  PhysPanelCPP bootservice install 155 87 reg\n");
+    Output::Print(L"  PhysPanelCPP batch get set 155 87 reg get\n");
+    Output::Print(L"  PhysPanelCPP startkeyboard\n");
+    Output::Print(L"  PhysPanelCPP keyboardagent\n");
+    Output::Print(L"  PhysPanelCPP touchservice\n");
+    Output::Print(L"  PhysPanelCPP --json touchstatus\n");
+    Output::Print(L"  PhysPanelCPP --json features query 52580392,50902630,59765208\n");
+    Output::Print(L"  PhysPanelCPP features apply reset 52580392,50902630,59765208 enable 52580392,50902630\n\n");
+}
+
+int ReportUsageError(const wchar_t* command, const wchar_t* message) {
+    if (Output::IsJsonMode()) {
+        Output::JsonObject().AddString(L"command", command).AddBool(L"success", false).AddString(L"error", message).Print();
+    }
+    else {
+        Output::PrintError(L"Error: %s\n", message);
+        PrintUsage();
+    }
+    return 1;
+}
+
+double DiagonalInches(const PanelManager::Dimensions& dims) {
+    return std::hypot((double)dims.WidthMm, (double)dims.HeightMm) / 25.4;
 }
 
 int HandleGet() {
-    auto dimsOpt = PanelManager::GetDisplaySize();
-    if (dimsOpt.has_value()) {
-        const auto& dims = dimsOpt.value();
-        double diagonalMm = std::sqrt(std::pow(dims.WidthMm, 2) + std::pow(dims.HeightMm, 2));
-        double diagonalInches = diagonalMm / 25.4;
-
-        wprintf(L"Current Size: Width = %u mm, Height = %u mm (Diagonal approx. %.2f inches)\n",
-            dims.WidthMm, dims.HeightMm, diagonalInches);
+    LONGLONG start = Trace::Timestamp();
+    PanelManager::PanelState state;
+    NTSTATUS status = PanelManager::QueryDisplayState(state);
+    bool success = (status == 0 && state.HasData);
+
+    if (Output::IsJsonMode()) {
+        Output::JsonObject json;
+        json.AddString(L"command", L"get")
+            .AddBool(L"success", success)
+            .AddNtStatus(L"ntstatus", status)
+            .AddBool(L"hasData", state.HasData)
+            .AddUInt(L"changeStamp", state.ChangeStamp);
+        if (state.HasData) {
+            json.AddUInt(L"widthMm", state.Dims.WidthMm)
+                .AddUInt(L"heightMm", state.Dims.HeightMm)
+                .AddUInt(L"raw", ((ULONGLONG)state.Dims.HeightMm << 32) | state.Dims.WidthMm)
+                .AddDouble(L"diagonalInches", DiagonalInches(state.Dims));
+        }
+        json.AddInt(L"elapsedUs", Trace::ElapsedUs(start)).Print();
+        return success ? 0 : -1;
+    }
+
+    if (success) {
+        Output::Print(L"Current Size: Width = %u mm, Height = %u mm (Diagonal approx. %.2f inches)\n",
+            state.Dims.WidthMm, state.Dims.HeightMm, DiagonalInches(state.Dims));
         return 0;
     }
     else {
-        fwprintf(stderr, L"Error: Failed to get display size. An override may not be set.\n");
+        Output::PrintError(L"Error: Failed to get display size. An override may not be set.\n");
         return -1;
     }
 }
 
+// Lenient on purpose: the command line has always accepted a leading number ("155mm"), unlike the
+// control pipe, which uses PanelManager::ParseDimensions.
+bool ParseCliDimensions(const wchar_t* widthArg, const wchar_t* heightArg, PanelManager::Dimensions& dims) {
+    wchar_t* endPtr = nullptr;
+
+    unsigned long w = wcstoul(widthArg, &endPtr, 10);
+    if (widthArg == endPtr || w == 0) return false;
+
+    unsigned long h = wcstoul(heightArg, &endPtr, 10);
+    if (heightArg == endPtr || h == 0) return false;
+
+    dims.WidthMm = static_cast<UINT>(w);
+    dims.HeightMm = static_cast<UINT>(h);
+    return true;
+}
+
 int HandleSet(int argc, wchar_t* argv[]) {
     if (argc != 4 && argc != 5) {
-        fwprintf(stderr, L"Error: The 'set' command requires width and height (optional: reg).\n");
-        PrintUsage();
-        return 1;
+        return ReportUsageError(L"set", L"The 'set' command requires width and height (optional: reg).");
     }
 
-    wchar_t* endPtr = nullptr;
-
-    unsigned long w = wcstoul(argv[2], &endPtr, 10);
-    if (argv[2] == endPtr || w == 0) {
-        fwprintf(stderr, L"Error: Arguments must be positive integers.\n");
-        PrintUsage();
-        return 1;
+    PanelManager::Dimensions newSize;
+    if (!ParseCliDimensions(argv[2], argv[3], newSize)) {
+        return ReportUsageError(L"set", L"Arguments must be positive integers.");
     }
 
-    unsigned long h = wcstoul(argv[3], &endPtr, 10);
-    if (argv[3] == endPtr || h == 0) {
-        fwprintf(stderr, L"Error: Arguments must be positive integers.\n");
-        PrintUsage();
-        return 1;
-    }
+    LONGLONG start = Trace::Timestamp();
+    bool changed = false;
+    NTSTATUS status = PanelManager::ApplyDisplaySize(newSize, &changed);
 
-    PanelManager::Dimensions newSize;
-    newSize.WidthMm = static_cast<UINT>(w);
-    newSize.HeightMm = static_cast<UINT>(h);
+    bool regRequested = (status == 0 && argc == 5 && _wcsicmp(argv[4], L"reg") == 0);
+    bool regChanged = false;
+    bool regSuccess = regRequested && PanelManager::SetOEMDeviceForm(&regChanged);
+
+    if (Output::IsJsonMode()) {
+        Output::JsonObject json;
+        json.AddString(L"command", L"set")
+            .AddBool(L"success", status == 0)
+            .AddNtStatus(L"ntstatus", status)
+            .AddBool(L"changed", changed)
+            .AddUInt(L"widthMm", newSize.WidthMm)
+            .AddUInt(L"heightMm", newSize.HeightMm);
+        if (regRequested) {
+            json.AddObject(L"registry", Output::JsonObject().AddBool(L"success", regSuccess).AddBool(L"changed", regChanged));
+        }
+        else {
+            json.AddNull(L"registry");
+        }
+        json.AddInt(L"elapsedUs", Trace::ElapsedUs(start)).Print();
+        return status == 0 ? 0 : -1;
+    }
 
-    NTSTATUS status = PanelManager::SetDisplaySize(newSize);
     if (status == 0) {
-        wprintf(L"Success: Display size has been set.\n");
-
-        if (argc == 5) {
-            wchar_t* arg = argv[4];
-            if (_wcsicmp(arg, L"reg") == 0) {
-                if (PanelManager::SetOEMDeviceForm()) {
-                    wprintf(L"Success: OEM DeviceForm registry key set to 0x2e.\n");
-                }
-                else {
-                    fwprintf(stderr, L"Error: Failed to set OEM DeviceForm registry key.\n");
-                }
+        if (changed) {
+            Output::Print(L"Success: Display size has been set.\n");
+        }
+        else {
+            Output::Print(L"Success: Display size already matches. No update published.\n");
+        }
+
+        if (regRequested) {
+            if (regSuccess) {
+                Output::Print(regChanged ? L"Success: OEM DeviceForm registry key set to 0x2e.\n"
+                    : L"Success: OEM DeviceForm registry key already 0x2e. No write needed.\n");
             }
             else {
-                wprintf(L"Info: Unknown argument '%s'. Registry update skipped. Use 'reg' to enable it.\n", arg);
+                Output::PrintError(L"Error: Failed to set OEM DeviceForm registry key.\n");
             }
         }
+        else if (argc == 5) {
+            Output::Print(L"Info: Unknown argument '%s'. Registry update skipped. Use 'reg' to enable it.\n", argv[4]);
+        }
         return 0;
     }
     else {
-        fwprintf(stderr, L"Error: Failed to set display size. This operation requires SYSTEM privileges.\n");
-        fwprintf(stderr, L"  > NTSTATUS Error Code: 0x%X\n", status);
+        Output::PrintError(L"Error: Failed to set display size. This operation requires SYSTEM privileges.\n");
+        Output::PrintError(L"  > NTSTATUS Error Code: 0x%X\n", status);
         return -1;
     }
 }
 
 int HandleReg() {
-    if (PanelManager::SetOEMDeviceForm()) {
-        wprintf(L"Success: OEM DeviceForm registry key set to 0x2e.\n");
+    LONGLONG start = Trace::Timestamp();
+    bool changed = false;
+    bool success = PanelManager::SetOEMDeviceForm(&changed);
+
+    if (Output::IsJsonMode()) {
+        Output::JsonObject().AddString(L"command", L"reg").AddBool(L"success", success).AddBool(L"changed", changed)
+            .AddInt(L"elapsedUs", Trace::ElapsedUs(start)).Print();
+        return success ? 0 : -1;
+    }
+
+    if (success) {
+        Output::Print(changed ? L"Success: OEM DeviceForm registry key set to 0x2e.\n"
+            : L"Success: OEM DeviceForm registry key already 0x2e. No write needed.\n");
         return 0;
     }
     else {
-        fwprintf(stderr, L"Error: Failed to set OEM DeviceForm registry key. This operation requires SYSTEM privileges.\n");
+        Output::PrintError(L"Error: Failed to set OEM DeviceForm registry key. This operation requires SYSTEM privileges.\n");
         return -1;
     }
 }
 
+// Splits a batch token stream into per-step argv arrays shaped like the process argv.
+bool ParseBatchSteps(wchar_t* programName, const std::vector<wchar_t*>& tokens, std::vector<std::vector<wchar_t*>>& steps, std::wstring& error) {
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        wchar_t* command = tokens[i];
+        std::vector<wchar_t*> step = { programName, command };
+
+        if (_wcsicmp(command, L"set") == 0) {
+            if (i + 2 >= tokens.size()) {
+                error = L"'set' in batch requires width and height.";
+                return false;
+            }
+            step.push_back(tokens[++i]);
+            step.push_back(tokens[++i]);
+            if (i + 1 < tokens.size() && _wcsicmp(tokens[i + 1], L"reg") == 0) {
+                step.push_back(tokens[++i]);
+            }
+        }
+        else if (_wcsicmp(command, L"get") != 0 && _wcsicmp(command, L"reg") != 0) {
+            error = L"'" + std::wstring(command) + L"' is not supported in batch mode (use get, set or reg).";
+            return false;
+        }
+
+        steps.push_back(step);
+    }
+    return true;
+}
+
+int HandleBatch(int argc, wchar_t* argv[]) {
+    std::vector<std::wstring> lines;
+    std::vector<wchar_t*> tokens;
+
+    if (argc == 3 && wcscmp(argv[2], L"-") == 0) {
+        wchar_t buffer[512];
+        while (fgetws(buffer, _countof(buffer), stdin)) {
+            lines.emplace_back(buffer);
+        }
+        for (auto& line : lines) {
+            wchar_t* context = nullptr;
+            for (wchar_t* token = wcstok_s(&line[0], L" \t\r\n", &context); token; token = wcstok_s(nullptr, L" \t\r\n", &context)) {
+                if (token[0] == L'#') break;
+                tokens.push_back(token);
+            }
+        }
+    }
+    else {
+        tokens.assign(argv + 2, argv + argc);
+    }
+
+    std::vector<std::vector<wchar_t*>> steps;
+    std::wstring error;
+    if (!ParseBatchSteps(argv[0], tokens, steps, error)) {
+        return ReportUsageError(L"batch", error.c_str());
+    }
+    if (steps.empty()) {
+        return ReportUsageError(L"batch", L"The 'batch' command requires at least one command.");
+    }
+
+    LONGLONG start = Trace::Timestamp();
+
+    int firstFailure = 0;
+    size_t succeeded = 0;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        auto& step = steps[i];
+        const wchar_t* command = step[1];
+
+        int result = 0;
+        if (_wcsicmp(command, L"get") == 0) {
+            result = HandleGet();
+        }
+        else if (_wcsicmp(command, L"set") == 0) {
+            result = HandleSet(static_cast<int>(step.size()), step.data());
+        }
+        else {
+            result = HandleReg();
+        }
+
+        if (!Output::IsJsonMode()) {
+            Output::Print(L"Step %zu/%zu: %s -> %s (%d)\n", i + 1, steps.size(), command, result == 0 ? L"OK" : L"FAILED", result);
+        }
+        if (result == 0) {
+            ++succeeded;
+        }
+        else if (firstFailure == 0) {
+            firstFailure = result;
+        }
+    }
+
+    if (Output::IsJsonMode()) {
+        Output::JsonObject().AddString(L"command", L"batch")
+            .AddBool(L"success", firstFailure == 0)
+            .AddUInt(L"steps", steps.size())
+            .AddUInt(L"succeeded", succeeded)
+            .AddInt(L"exitCode", firstFailure)
+            .AddInt(L"elapsedUs", Trace::ElapsedUs(start)).Print();
+    }
+    else {
+        Output::Print(L"Batch: %zu of %zu steps succeeded.\n", succeeded, steps.size());
+    }
+    return firstFailure;
+}
+
+HANDLE g_hWatchStopEvent = NULL;
+
+BOOL WINAPI WatchCtrlHandler(DWORD ctrlType) {
+    UNREFERENCED_PARAMETER(ctrlType);
+    if (g_hWatchStopEvent) SetEvent(g_hWatchStopEvent);
+    return TRUE;
+}
+
+int HandleWatch(int argc, wchar_t* argv[]) {
+    if (argc != 4 && argc != 5) {
+        return ReportUsageError(L"watch", L"The 'watch' command requires width and height (optional: reg).");
+    }
+
+    PanelManager::Dimensions target;
+    if (!ParseCliDimensions(argv[2], argv[3], target)) {
+        return ReportUsageError(L"watch", L"Arguments must be positive integers.");
+    }
+
+    HANDLE hWatchMutex = CreateMutexW(NULL, TRUE, PanelManager::PANEL_WATCH_MUTEX_NAME);
+    if (hWatchMutex == NULL) {
+        Output::PrintError(L"Error: Failed to create watch mutex (Error: %lu).\n", GetLastError());
+        return -1;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        LogDebug(L"Watch mode already running. Exiting.");
+        CloseHandle(hWatchMutex);
+        return 0;
+    }
+
+    bool guardDeviceForm = (argc == 5 && _wcsicmp(argv[4], L"reg") == 0);
+    if (guardDeviceForm) {
+        if (!PanelManager::SetOEMDeviceForm()) {
+            Output::PrintError(L"Error: Failed to set OEM DeviceForm registry key.\n");
+        }
+    }
+
+    g_hWatchStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    SetConsoleCtrlHandler(WatchCtrlHandler, TRUE);
+
+    int result = 0;
+    {
+        PanelManager::DeviceFormGuard deviceFormGuard;
+        if (guardDeviceForm && !deviceFormGuard.Start()) {
+            LogDebug(L"Watch mode: DeviceForm guard unavailable.");
+        }
+
+        PanelManager::DisplaySizeWatchdog watchdog;
+        NTSTATUS status = watchdog.Start(target);
+        if (status == 0) {
+            bool changed = false;
+            status = PanelManager::ApplyDisplaySize(target, &changed);
+            LogDebug(L"Watch mode: Initial apply (NTSTATUS 0x%X, changed: %d).", status, changed);
+        }
+        if (Output::IsJsonMode()) {
+            Output::JsonObject().AddString(L"command", L"watch")
+                .AddBool(L"success", status == 0)
+                .AddNtStatus(L"ntstatus", status)
+                .AddUInt(L"widthMm", target.WidthMm)
+                .AddUInt(L"heightMm", target.HeightMm).Print();
+        }
+
+        if (status == 0) {
+            if (!Output::IsJsonMode()) {
+                Output::Print(L"Watching display size override (%u x %u mm).\n", target.WidthMm, target.HeightMm);
+            }
+            // The override can be dropped across suspend; reassert it on every wake rather than waiting
+            // for another component to publish.
+            Power::Monitor power;
+            HANDLE waitHandles[] = { g_hWatchStopEvent, NULL };
+            DWORD waitCount = 1;
+            if (power.Start()) waitHandles[waitCount++] = power.WakeEvent();
+
+            while (WaitForMultipleObjects(waitCount, waitHandles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+                bool changed = false;
+                NTSTATUS applyStatus = PanelManager::ApplyDisplaySize(target, &changed);
+                bool restored = false;
+                if (guardDeviceForm) PanelManager::SetOEMDeviceForm(&restored);
+                LogDebug(L"Watch mode: Wake. Reasserted display size (NTSTATUS 0x%X, changed: %d, DeviceForm restored: %d).",
+                    applyStatus, changed, restored);
+            }
+            LogDebug(L"Watch mode stopping after %lu rewrites and %lu DeviceForm restores.",
+                watchdog.RewriteCount(), deviceFormGuard.RestoreCount());
+        }
+        else {
+            if (!Output::IsJsonMode()) {
+                Output::PrintError(L"Error: Failed to subscribe to or apply the display size override.\n");
+                Output::PrintError(L"  > NTSTATUS Error Code: 0x%X\n", status);
+            }
+            result = -1;
+        }
+    }
+
+    SetConsoleCtrlHandler(WatchCtrlHandler, FALSE);
+    CloseHandle(g_hWatchStopEvent);
+    g_hWatchStopEvent = NULL;
+    ReleaseMutex(hWatchMutex);
+    CloseHandle(hWatchMutex);
+    return result;
+}
+
+int ReportBootServiceResult(const wchar_t* step, DWORD result) {
+    if (Output::IsJsonMode()) {
+        Output::JsonObject().AddString(L"command", L"bootservice")
+            .AddString(L"step", step)
+            .AddBool(L"success", result == NO_ERROR)
+            .AddUInt(L"error", result).Print();
+    }
+    else if (result == NO_ERROR) {
+        Output::Print(L"Success: Boot service %s.\n", _wcsicmp(step, L"install") == 0 ? L"installed and started" : L"removed");
+    }
+    else {
+        Output::PrintError(L"Error: Failed to %s the boot service (Error: %lu). Requires administrator rights.\n", step, result);
+    }
+    return result == NO_ERROR ? 0 : -1;
+}
+
+int HandleBootService(int argc, wchar_t* argv[]) {
+    if (argc == 3 && _wcsicmp(argv[2], L"uninstall") == 0) {
+        return ReportBootServiceResult(L"uninstall", BootService::Uninstall());
+    }
+
+    bool install = (argc >= 3 && _wcsicmp(argv[2], L"install") == 0);
+    int first = install ? 3 : 2;
+    if (argc != first + 2 && argc != first + 3) {
+        return ReportUsageError(L"bootservice", L"The 'bootservice' command requires 'install <w> <h> [reg]' or 'uninstall'.");
+    }
+
+    PanelManager::Dimensions target;
+    if (!ParseCliDimensions(argv[first], argv[first + 1], target)) {
+        return ReportUsageError(L"bootservice", L"Arguments must be positive integers.");
+    }
+    bool guardDeviceForm = (argc == first + 3 && _wcsicmp(argv[first + 2], L"reg") == 0);
+
+    if (install) {
+        return ReportBootServiceResult(L"install", BootService::Install(target, guardDeviceForm));
+    }
+
+    // Service entry point: only meaningful when started by the SCM.
+    DWORD result = BootService::Run(target, guardDeviceForm);
+    if (result == ERROR_FAILED_SERVICE_CONTROLLER_CONNECT) {
+        LogDebug(L"bootservice must be started by the service control manager. Use 'bootservice install'.");
+    }
+    return result == NO_ERROR ? 0 : -1;
+}
+
 int HandleStartKeyboard() {
     try {
         KeyboardManager::StartTouchKeyboard();
@@ -139,59 +496,397 @@ int HandleStartKeyboard() {
     catch (const std::exception&) { return -1; }
 }
 
-int HandleTouchService() {
-    return TouchManager::RunService();
+int HandleKeyboardAgent() {
+    return KeyboardManager::RunAgent();
+}
+
+int HandleTouchService(int argc, wchar_t* argv[]) {
+    TouchManager::ServiceOptions options;
+    for (int i = 2; i < argc; ++i) {
+        if (_wcsicmp(argv[i], L"--gamepad-touch") == 0) {
+            options.GamepadTouch = true;
+        }
+        else {
+            return ReportUsageError(L"touchservice", L"Unknown 'touchservice' option (use --gamepad-touch).");
+        }
+    }
+    return TouchManager::RunService(options);
+}
+
+// UTC, ISO 8601. Zero means "never" and formats as an empty string.
+void FormatFileTime(ULONGLONG fileTime, wchar_t (&buffer)[32]) {
+    buffer[0] = L'\0';
+    SYSTEMTIME st;
+    if (fileTime == 0 || !FileTimeToSystemTime(reinterpret_cast<const FILETIME*>(&fileTime), &st)) return;
+    swprintf_s(buffer, L"%04u-%02u-%02uT%02u:%02u:%02u.%03uZ",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
 }
 
-bool AttachConsoleAndRedirectIO() {
-    bool consoleAttached = false;
-    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
-        consoleAttached = true;
+const wchar_t* WorkerStateName(StatusBlock::WorkerState state) {
+    switch (state) {
+    case StatusBlock::WorkerState::Launching: return L"launching";
+    case StatusBlock::WorkerState::Probing: return L"probing";
+    case StatusBlock::WorkerState::Ready: return L"ready";
+    case StatusBlock::WorkerState::Backoff: return L"backoff";
+    case StatusBlock::WorkerState::Exited: return L"exited";
+    default: return L"unused";
     }
-    else if (AllocConsole()) {
-        consoleAttached = true;
+}
+
+const wchar_t* DesktopStateName(StatusBlock::DesktopState state) {
+    switch (state) {
+    case StatusBlock::DesktopState::Probing: return L"probing";
+    case StatusBlock::DesktopState::Ready: return L"ready";
+    case StatusBlock::DesktopState::Failed: return L"failed";
+    case StatusBlock::DesktopState::Stopped: return L"stopped";
+    default: return L"unused";
     }
+}
 
-    if (!consoleAttached) {
-        return false;
+int HandleTouchStatus() {
+    StatusBlock::Reader reader;
+    StatusBlock::Status status;
+    bool success = reader.Open() && reader.Read(status);
+
+    if (!success) {
+        if (Output::IsJsonMode()) {
+            Output::JsonObject().AddString(L"command", L"touchstatus").AddBool(L"success", false)
+                .AddString(L"error", L"Touch service status unavailable.").Print();
+        }
+        else {
+            Output::PrintError(L"Error: Touch service status unavailable. Is the touch service running?\n");
+        }
+        return -1;
     }
 
-    FILE* fp_stdout, * fp_stderr;
-    freopen_s(&fp_stdout, "CONOUT$", "w", stdout);
-    freopen_s(&fp_stderr, "CONOUT$", "w", stderr);
+    wchar_t timeText[32];
+    if (Output::IsJsonMode()) {
+        std::vector<Output::JsonObject> workers;
+        for (const auto& worker : status.Workers) {
+            if (worker.State == StatusBlock::WorkerState::Unused) continue;
+            Output::JsonObject json;
+            json.AddUInt(L"sessionId", worker.SessionId)
+                .AddString(L"state", WorkerStateName(worker.State))
+                .AddUInt(L"processId", worker.ProcessId)
+                .AddUInt(L"crashCount", worker.CrashCount)
+                .AddUInt(L"exitCode", worker.ExitCode)
+                .AddUInt(L"privateBytes", worker.PrivateBytes)
+                .AddUInt(L"workingSetBytes", worker.WorkingSetBytes);
+            FormatFileTime(worker.LaunchTime, timeText);
+            json.AddString(L"launchTime", timeText);
+            FormatFileTime(worker.ExitTime, timeText);
+            json.AddString(L"exitTime", timeText);
+            workers.push_back(json);
+        }
 
-    (void)_setmode(_fileno(stdout), _O_WTEXT);
-    (void)_setmode(_fileno(stderr), _O_WTEXT);
+        std::vector<Output::JsonObject> desktops;
+        for (const auto& desktop : status.Desktops) {
+            if (desktop.State == StatusBlock::DesktopState::Unused) continue;
+            Output::JsonObject json;
+            json.AddUInt(L"sessionId", desktop.SessionId)
+                .AddString(L"desktop", desktop.Name)
+                .AddString(L"state", DesktopStateName(desktop.State))
+                .AddUInt(L"probeAttempts", desktop.ProbeAttempts)
+                .AddUInt(L"lastError", desktop.LastError);
+            FormatFileTime(desktop.ProbeStartTime, timeText);
+            json.AddString(L"probeStartTime", timeText);
+            FormatFileTime(desktop.ReadyTime, timeText);
+            json.AddString(L"readyTime", timeText);
+            desktops.push_back(json);
+        }
+
+        Output::JsonObject json;
+        json.AddString(L"command", L"touchstatus")
+            .AddBool(L"success", true)
+            .AddUInt(L"layoutVersion", status.LayoutVersion)
+            .AddUInt(L"sequence", (ULONG)status.Sequence)
+            .AddUInt(L"masterProcessId", status.MasterProcessId)
+            .AddUInt(L"masterPrivateBytes", status.MasterPrivateBytes)
+            .AddUInt(L"masterWorkingSetBytes", status.MasterWorkingSetBytes);
+        FormatFileTime(status.MasterStartTime, timeText);
+        json.AddString(L"masterStartTime", timeText);
+        FormatFileTime(status.UpdateTime, timeText);
+        json.AddString(L"updateTime", timeText)
+            .AddInt(L"activeSessionId", (LONG)status.ActiveSessionId)
+            .AddBool(L"panelHasData", status.PanelHasData != 0)
+            .AddUInt(L"panelWidthMm", status.PanelWidthMm)
+            .AddUInt(L"panelHeightMm", status.PanelHeightMm)
+            .AddUInt(L"panelChangeStamp", status.PanelChangeStamp)
+            .AddArray(L"workers", workers)
+            .AddArray(L"desktops", desktops)
+            .Print();
+        return 0;
+    }
 
+    FormatFileTime(status.UpdateTime, timeText);
+    Output::Print(L"Touch Service: master PID %lu, active session %ld, last update %s (#%ld)\n",
+        status.MasterProcessId, (LONG)status.ActiveSessionId, timeText, status.Sequence);
+    Output::Print(L"  Memory:  master %llu KB private, %llu KB working set\n",
+        status.MasterPrivateBytes / 1024, status.MasterWorkingSetBytes / 1024);
+    if (status.PanelHasData) {
+        Output::Print(L"  Panel:   %u x %u mm (stamp %lu)\n", status.PanelWidthMm, status.PanelHeightMm, status.PanelChangeStamp);
+    }
+    else {
+        Output::Print(L"  Panel:   no override set\n");
+    }
+    for (const auto& worker : status.Workers) {
+        if (worker.State == StatusBlock::WorkerState::Unused) continue;
+        FormatFileTime(worker.LaunchTime, timeText);
+        Output::Print(L"  Worker:  session %lu %s, PID %lu, launched %s, %lu crashes, %llu KB private, %llu KB working set\n",
+            worker.SessionId, WorkerStateName(worker.State), worker.ProcessId, timeText, worker.CrashCount,
+            worker.PrivateBytes / 1024, worker.WorkingSetBytes / 1024);
+    }
+    for (const auto& desktop : status.Desktops) {
+        if (desktop.State == StatusBlock::DesktopState::Unused) continue;
+        Output::Print(L"  Desktop: session %lu %s %s after %lu probe attempts (last error %lu)\n",
+            desktop.SessionId, desktop.Name, DesktopStateName(desktop.State), desktop.ProbeAttempts, desktop.LastError);
+    }
+    return 0;
+}
+
+const wchar_t* FeatureStateName(FeatureManager::EnabledState state) {
+    switch (state) {
+    case FeatureManager::EnabledState::Disabled: return L"disabled";
+    case FeatureManager::EnabledState::Enabled: return L"enabled";
+    default: return L"default";
+    }
+}
+
+const wchar_t* FeatureActionName(FeatureManager::Action action) {
+    switch (action) {
+    case FeatureManager::Action::Enable: return L"enable";
+    case FeatureManager::Action::Disable: return L"disable";
+    default: return L"reset";
+    }
+}
+
+const wchar_t* FeatureTypeName(FeatureManager::ConfigurationType type) {
+    return type == FeatureManager::ConfigurationType::Boot ? L"boot" : L"runtime";
+}
+
+bool ParseFeatureType(const wchar_t* arg, FeatureManager::ConfigurationType& type) {
+    if (_wcsicmp(arg, L"runtime") == 0) type = FeatureManager::ConfigurationType::Runtime;
+    else if (_wcsicmp(arg, L"boot") == 0) type = FeatureManager::ConfigurationType::Boot;
+    else return false;
     return true;
 }
 
+bool ParseFeatureAction(const wchar_t* arg, FeatureManager::Action& action) {
+    if (_wcsicmp(arg, L"enable") == 0) action = FeatureManager::Action::Enable;
+    else if (_wcsicmp(arg, L"disable") == 0) action = FeatureManager::Action::Disable;
+    else if (_wcsicmp(arg, L"reset") == 0) action = FeatureManager::Action::Reset;
+    else return false;
+    return true;
+}
+
+// Appends the IDs in one argument ("52580392" or "52580392,50902630").
+bool ParseFeatureIds(const wchar_t* arg, std::vector<ULONG>& ids) {
+    const wchar_t* cursor = arg;
+    while (*cursor) {
+        wchar_t* endPtr = nullptr;
+        unsigned long id = wcstoul(cursor, &endPtr, 10);
+        if (endPtr == cursor || id == 0 || (*endPtr && *endPtr != L',')) return false;
+        ids.push_back(id);
+        cursor = *endPtr ? endPtr + 1 : endPtr;
+    }
+    return !ids.empty();
+}
+
+int HandleFeaturesQuery(int argc, wchar_t* argv[]) {
+    LONGLONG start = Trace::Timestamp();
+    FeatureManager::ConfigurationType type = FeatureManager::ConfigurationType::Runtime;
+    std::vector<ULONG> ids;
+
+    int arg = 3;
+    if (arg < argc && ParseFeatureType(argv[arg], type)) ++arg;
+    for (; arg < argc; ++arg) {
+        if (!ParseFeatureIds(argv[arg], ids)) {
+            return ReportUsageError(L"features", L"'features query' expects decimal feature IDs.");
+        }
+    }
+    if (ids.empty()) {
+        return ReportUsageError(L"features", L"'features query' requires at least one feature ID.");
+    }
+
+    std::vector<FeatureManager::FeatureState> states;
+    ULONGLONG changeStamp = 0;
+    NTSTATUS status = FeatureManager::Query(ids, type, states, &changeStamp);
+    bool success = (status >= 0);
+
+    bool allEnabled = success;
+    for (const auto& state : states) {
+        if (state.State != FeatureManager::EnabledState::Enabled) allEnabled = false;
+    }
+
+    if (Output::IsJsonMode()) {
+        std::vector<Output::JsonObject> features;
+        for (const auto& state : states) {
+            Output::JsonObject json;
+            json.AddUInt(L"id", state.FeatureId)
+                .AddBool(L"found", state.Found)
+                .AddString(L"state", FeatureStateName(state.State))
+                .AddUInt(L"priority", state.Priority)
+                .AddUInt(L"variant", state.Variant);
+            features.push_back(json);
+        }
+
+        Output::JsonObject().AddString(L"command", L"features")
+            .AddString(L"action", L"query")
+            .AddBool(L"success", success)
+            .AddNtStatus(L"ntstatus", status)
+            .AddString(L"type", FeatureTypeName(type))
+            .AddUInt(L"changeStamp", changeStamp)
+            .AddBool(L"allEnabled", allEnabled)
+            .AddArray(L"features", features)
+            .AddInt(L"elapsedUs", Trace::ElapsedUs(start))
+            .Print();
+        return success ? 0 : -1;
+    }
+
+    if (!success) {
+        Output::PrintError(L"Error: Feature query failed (NTSTATUS: 0x%X).\n", status);
+        return -1;
+    }
+
+    for (const auto& state : states) {
+        if (state.Found) {
+            Output::Print(L"Feature %lu: %s (priority %lu, variant %lu)\n", state.FeatureId, FeatureStateName(state.State), state.Priority, state.Variant);
+        }
+        else {
+            Output::Print(L"Feature %lu: default (no configuration)\n", state.FeatureId);
+        }
+    }
+    Output::Print(allEnabled ? L"All %zu features enabled (%s).\n" : L"Not all %zu features enabled (%s).\n", states.size(), FeatureTypeName(type));
+    return 0;
+}
+
+int HandleFeaturesApply(int argc, wchar_t* argv[]) {
+    LONGLONG start = Trace::Timestamp();
+    bool bothTypes = true;
+    FeatureManager::ConfigurationType onlyType = FeatureManager::ConfigurationType::Runtime;
+
+    struct ApplyStep {
+        FeatureManager::Action Action;
+        std::vector<ULONG> Ids;
+    };
+    std::vector<ApplyStep> steps;
+
+    int arg = 3;
+    if (arg < argc && ParseFeatureType(argv[arg], onlyType)) {
+        bothTypes = false;
+        ++arg;
+    }
+    for (; arg < argc; ++arg) {
+        FeatureManager::Action action;
+        if (ParseFeatureAction(argv[arg], action)) {
+            steps.push_back({ action, {} });
+        }
+        else if (steps.empty() || !ParseFeatureIds(argv[arg], steps.back().Ids)) {
+            return ReportUsageError(L"features", L"'features apply' expects enable, disable or reset followed by decimal feature IDs.");
+        }
+    }
+    if (steps.empty()) {
+        return ReportUsageError(L"features", L"'features apply' requires an action and feature IDs.");
+    }
+    for (const auto& step : steps) {
+        if (step.Ids.empty()) {
+            return ReportUsageError(L"features", L"Each 'features apply' action requires at least one feature ID.");
+        }
+    }
+
+    // Runtime first, as the GUI does, so a failure leaves boot-time state untouched.
+    FeatureManager::ConfigurationType types[] = { FeatureManager::ConfigurationType::Runtime, FeatureManager::ConfigurationType::Boot };
+    size_t typeCount = bothTypes ? 2 : 1;
+    if (!bothTypes) types[0] = onlyType;
+
+    NTSTATUS status = 0;
+    std::vector<Output::JsonObject> results;
+    for (const auto& step : steps) {
+        for (size_t t = 0; t < typeCount && status >= 0; ++t) {
+            status = FeatureManager::Apply(step.Ids, step.Action, types[t]);
+            results.push_back(Output::JsonObject().AddString(L"action", FeatureActionName(step.Action))
+                .AddString(L"type", FeatureTypeName(types[t]))
+                .AddUInt(L"count", step.Ids.size())
+                .AddNtStatus(L"ntstatus", status));
+            if (!Output::IsJsonMode()) {
+                if (status >= 0) Output::Print(L"Success: %s %zu features (%s).\n", FeatureActionName(step.Action), step.Ids.size(), FeatureTypeName(types[t]));
+                else Output::PrintError(L"Error: Failed to %s %zu features (%s, NTSTATUS: 0x%X). Requires administrator rights.\n",
+                    FeatureActionName(step.Action), step.Ids.size(), FeatureTypeName(types[t]), status);
+            }
+        }
+        if (status < 0) break;
+    }
+
+    bool success = (status >= 0);
+    if (Output::IsJsonMode()) {
+        Output::JsonObject().AddString(L"command", L"features")
+            .AddString(L"action", L"apply")
+            .AddBool(L"success", success)
+            .AddNtStatus(L"ntstatus", status)
+            .AddArray(L"steps", results)
+            .AddInt(L"elapsedUs", Trace::ElapsedUs(start))
+            .Print();
+    }
+    return success ? 0 : -1;
+}
+
+int HandleFeatures(int argc, wchar_t* argv[]) {
+    if (argc >= 3 && _wcsicmp(argv[2], L"query") == 0) {
+        return HandleFeaturesQuery(argc, argv);
+    }
+    if (argc >= 3 && _wcsicmp(argv[2], L"apply") == 0) {
+        return HandleFeaturesApply(argc, argv);
+    }
+    return ReportUsageError(L"features", L"The 'features' command requires 'query' or 'apply'.");
+}
+
 int wmain(int argc, wchar_t* argv[]) {
+    Trace::Register();
+    atexit(Trace::Unregister);
+
     _wsetlocale(LC_ALL, L"");
 
-    bool needsConsole = true;
+    // Global switches may appear anywhere; strip them so handlers keep seeing argv[1] as the command.
+    int commandArgc = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (_wcsicmp(argv[i], L"--json") == 0) {
+            Output::SetJsonMode(true);
+            continue;
+        }
+        if (_wcsicmp(argv[i], L"--quiet") == 0 || _wcsicmp(argv[i], L"-q") == 0) {
+            Output::SetQuietMode(true);
+            continue;
+        }
+        argv[commandArgc++] = argv[i];
+    }
+    argc = commandArgc;
+
     wchar_t* action = nullptr;
 
+    InitializeLogging(argc >= 2 ? argv[1] : nullptr);
+    atexit(ShutdownLogging);
+
     if (argc >= 2) {
         action = argv[1];
-        if (_wcsicmp(action, L"startkeyboard") == 0 || _wcsicmp(action, L"touchservice") == 0) {
-#if defined(_DEBUG)
-            needsConsole = true;
-#else
-            needsConsole = false;
-#endif
+#if !defined(_DEBUG)
+        if (_wcsicmp(action, L"startkeyboard") == 0 || _wcsicmp(action, L"keyboardagent") == 0 ||
+            _wcsicmp(action, L"touchservice") == 0 || _wcsicmp(action, L"watch") == 0) {
+            Output::SetConsoleAllowed(false);
+        }
+        if (_wcsicmp(action, L"bootservice") == 0 && argc >= 3 &&
+            _wcsicmp(argv[2], L"install") != 0 && _wcsicmp(argv[2], L"uninstall") != 0) {
+            Output::SetConsoleAllowed(false);
         }
+#endif
     }
 
-    bool consoleAttached = false;
-    if (needsConsole) {
-        consoleAttached = AttachConsoleAndRedirectIO();
-    }
+#if defined(_DEBUG)
+    // Debug log records are echoed to the console from the writer thread, so attach up front.
+    Output::EnsureConsole();
+#endif
 
     if (argc < 2) {
-        if (consoleAttached) {
-            PrintUsage();
-        }
+        PrintUsage();
         return 1;
     }
 
@@ -204,16 +899,35 @@ int wmain(int argc, wchar_t* argv[]) {
     if (_wcsicmp(action, L"reg") == 0) {
         return HandleReg();
     }
+    if (_wcsicmp(action, L"batch") == 0) {
+        return HandleBatch(argc, argv);
+    }
+    if (_wcsicmp(action, L"bench") == 0) {
+        return Bench::Run(argc, argv);
+    }
+    if (_wcsicmp(action, L"watch") == 0) {
+        return HandleWatch(argc, argv);
+    }
+    if (_wcsicmp(action, L"bootservice") == 0) {
+        return HandleBootService(argc, argv);
+    }
     if (_wcsicmp(action, L"startkeyboard") == 0) {
         return HandleStartKeyboard();
     }
+    if (_wcsicmp(action, L"keyboardagent") == 0) {
+        return HandleKeyboardAgent();
+    }
     if (_wcsicmp(action, L"touchservice") == 0) {
-        return HandleTouchService();
+        return HandleTouchService(argc, argv);
     }
-
-    if (consoleAttached) {
-        fwprintf(stderr, L"Error: Unknown command '%s'.\n", argv[1]);
-        PrintUsage();
+    if (_wcsicmp(action, L"touchstatus") == 0) {
+        return HandleTouchStatus();
+    }
+    if (_wcsicmp(action, L"features") == 0) {
+        return HandleFeatures(argc, argv);
     }
+
+    Output::PrintError(L"Error: Unknown command '%s'.\n", argv[1]);
+    PrintUsage();
     return 1;
 }
\ No newline at end of file
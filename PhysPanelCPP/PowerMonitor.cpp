@@ -0,0 +1,109 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "PowerMonitor.h"
+#include "Utils.h"
+#include "Trace.h"
+
+#pragma comment(lib, "PowrProf.lib")
+
+namespace Power {
+
+    // GUID_CONSOLE_DISPLAY_STATE payload.
+    const DWORD DISPLAY_STATE_OFF = 0;
+
+    bool Monitor::Start() {
+        if (m_hDisplayOn) return true;
+
+        m_hDisplayOn = CreateEventW(NULL, TRUE, TRUE, NULL);
+        m_hWake = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!m_hDisplayOn || !m_hWake) {
+            LogDebug(L"Power: CreateEventW failed (Error: %d).", GetLastError());
+            Stop();
+            return false;
+        }
+
+        m_params.Callback = OnPowerEvent;
+        m_params.Context = this;
+
+        // The display registration delivers the current state right away.
+        DWORD dwErr = PowerSettingRegisterNotification(&GUID_CONSOLE_DISPLAY_STATE, DEVICE_NOTIFY_CALLBACK, &m_params, &m_hDisplayNotify);
+        if (dwErr != ERROR_SUCCESS) {
+            LogDebug(L"Power: Display state notifications unavailable (Error: %d).", dwErr);
+            m_hDisplayNotify = NULL;
+        }
+
+        dwErr = PowerRegisterSuspendResumeNotification(DEVICE_NOTIFY_CALLBACK, &m_params, &m_hSuspendNotify);
+        if (dwErr != ERROR_SUCCESS) {
+            LogDebug(L"Power: Suspend/resume notifications unavailable (Error: %d).", dwErr);
+            m_hSuspendNotify = NULL;
+        }
+        return true;
+    }
+
+    // Unregistering waits for in-flight callbacks, so the events can be closed afterwards.
+    void Monitor::Stop() {
+        if (m_hSuspendNotify) { PowerUnregisterSuspendResumeNotification(m_hSuspendNotify); m_hSuspendNotify = NULL; }
+        if (m_hDisplayNotify) { PowerSettingUnregisterNotification(m_hDisplayNotify); m_hDisplayNotify = NULL; }
+        if (m_hWake) { CloseHandle(m_hWake); m_hWake = NULL; }
+        if (m_hDisplayOn) { CloseHandle(m_hDisplayOn); m_hDisplayOn = NULL; }
+    }
+
+    bool Monitor::IsDisplayOn() const {
+        return !m_hDisplayOn || WaitForSingleObject(m_hDisplayOn, 0) == WAIT_OBJECT_0;
+    }
+
+    ULONG CALLBACK Monitor::OnPowerEvent(PVOID context, ULONG type, PVOID setting) {
+        auto pMonitor = static_cast<Monitor*>(context);
+
+        switch (type) {
+        case PBT_POWERSETTINGCHANGE: {
+            auto pSetting = static_cast<const POWERBROADCAST_SETTING*>(setting);
+            if (pSetting && IsEqualGUID(pSetting->PowerSetting, GUID_CONSOLE_DISPLAY_STATE) && pSetting->DataLength >= sizeof(DWORD)) {
+                pMonitor->OnDisplayState(*reinterpret_cast<const DWORD*>(pSetting->Data));
+            }
+            break;
+        }
+        case PBT_APMSUSPEND:
+            LogDebug(L"Power: Suspending.");
+            break;
+        case PBT_APMRESUMEAUTOMATIC:
+        case PBT_APMRESUMESUSPEND:
+            LogDebug(L"Power: Resumed (0x%X).", type);
+            Trace::Milestone(L"Power", L"Resumed", type);
+            SetEvent(pMonitor->m_hWake);
+            break;
+        }
+        return ERROR_SUCCESS;
+    }
+
+    void Monitor::OnDisplayState(DWORD state) {
+        if (state == DISPLAY_STATE_OFF) {
+            LogDebug(L"Power: Display off.");
+            ResetEvent(m_hDisplayOn);
+            return;
+        }
+
+        // Dimmed counts as on. Only an off -> on transition is a wake.
+        if (!IsDisplayOn()) {
+            LogDebug(L"Power: Display on (state %u).", state);
+            Trace::Milestone(L"Power", L"DisplayOn", state);
+            SetEvent(m_hDisplayOn);
+            SetEvent(m_hWake);
+        }
+    }
+}
\ No newline at end of file
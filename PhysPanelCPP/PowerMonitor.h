@@ -0,0 +1,59 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+#include <powrprof.h>
+
+namespace Power {
+
+    // Tracks the console display state and suspend/resume through powrprof callbacks. No window is
+    // needed, so the session 0 master, session workers and watch mode share it. Callbacks run on a
+    // system thread and only flip the events below.
+    class Monitor {
+    public:
+        Monitor() = default;
+        ~Monitor() { Stop(); }
+
+        Monitor(const Monitor&) = delete;
+        Monitor& operator=(const Monitor&) = delete;
+
+        // Returns false only when the events cannot be created. A failed registration is logged and
+        // leaves the display reported as on, so callers behave as before.
+        bool Start();
+
+        void Stop();
+
+        // Manual-reset, signaled while the console display is on or dimmed.
+        HANDLE DisplayOnEvent() const { return m_hDisplayOn; }
+
+        // Auto-reset, signaled after resume from suspend and when the display turns back on.
+        HANDLE WakeEvent() const { return m_hWake; }
+
+        bool IsDisplayOn() const;
+
+    private:
+        static ULONG CALLBACK OnPowerEvent(PVOID context, ULONG type, PVOID setting);
+
+        void OnDisplayState(DWORD state);
+
+        DEVICE_NOTIFY_SUBSCRIBE_PARAMETERS m_params = {};
+        HPOWERNOTIFY m_hDisplayNotify = NULL;
+        HPOWERNOTIFY m_hSuspendNotify = NULL;
+        HANDLE m_hDisplayOn = NULL;
+        HANDLE m_hWake = NULL;
+    };
+}
\ No newline at end of file
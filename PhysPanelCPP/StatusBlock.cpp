@@ -0,0 +1,384 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "StatusBlock.h"
+#include "Utils.h"
+#include <sddl.h>
+
+namespace StatusBlock {
+
+    // Writers run as SYSTEM (the master and its session workers); interactive users may read.
+    constexpr auto SECTION_SDDL = L"D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;GR;;;IU)";
+    constexpr auto WRITER_MUTEX_SDDL = L"D:P(A;;GA;;;SY)(A;;GA;;;BA)";
+    // A writer that cannot get the lock in time skips its update rather than stall the service.
+    const DWORD WRITER_LOCK_TIMEOUT_MS = 100;
+    const int READ_MAX_ATTEMPTS = 64;
+
+    HANDLE g_hSection = NULL;
+    HANDLE g_hWriterMutex = NULL;
+    HANDLE g_hChangedEvent = NULL;
+    Status* g_status = nullptr;
+
+    ULONGLONG CurrentFileTime() {
+        ULONGLONG now = 0;
+        GetSystemTimeAsFileTime(reinterpret_cast<FILETIME*>(&now));
+        return now;
+    }
+
+    // Holds the writer mutex for one update. The sequence is odd while the update is in flight.
+    class WriteScope {
+    public:
+        WriteScope() {
+            if (!g_status) return;
+
+            DWORD waitResult = WaitForSingleObject(g_hWriterMutex, WRITER_LOCK_TIMEOUT_MS);
+            if (waitResult != WAIT_OBJECT_0 && waitResult != WAIT_ABANDONED) return;
+            m_locked = true;
+
+            // A writer that died mid-update left the counter odd; keep it odd and even it out on release.
+            if ((g_status->Sequence & 1) == 0) InterlockedIncrement(&g_status->Sequence);
+        }
+
+        ~WriteScope() {
+            if (!m_locked) return;
+            g_status->UpdateTime = CurrentFileTime();
+            InterlockedIncrement(&g_status->Sequence);
+            ReleaseMutex(g_hWriterMutex);
+        }
+
+        WriteScope(const WriteScope&) = delete;
+        WriteScope& operator=(const WriteScope&) = delete;
+
+        bool Locked() const { return m_locked; }
+
+    private:
+        bool m_locked = false;
+    };
+
+    bool Map(DWORD access) {
+        g_status = static_cast<Status*>(MapViewOfFile(g_hSection, access, 0, 0, sizeof(Status)));
+        if (!g_status) {
+            LogDebug(L"StatusBlock: MapViewOfFile failed (Error: %d).", GetLastError());
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool Create() {
+        if (g_status) return true;
+
+        PSECURITY_DESCRIPTOR pSectionSd = nullptr;
+        PSECURITY_DESCRIPTOR pMutexSd = nullptr;
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(SECTION_SDDL, SDDL_REVISION_1, &pSectionSd, NULL) ||
+            !ConvertStringSecurityDescriptorToSecurityDescriptorW(WRITER_MUTEX_SDDL, SDDL_REVISION_1, &pMutexSd, NULL)) {
+            LogDebug(L"StatusBlock: Invalid SDDL (Error: %d).", GetLastError());
+            if (pSectionSd) LocalFree(pSectionSd);
+            return false;
+        }
+
+        SECURITY_ATTRIBUTES sectionSa = { sizeof(sectionSa), pSectionSd, FALSE };
+        SECURITY_ATTRIBUTES mutexSa = { sizeof(mutexSa), pMutexSd, FALSE };
+        g_hSection = CreateFileMappingW(INVALID_HANDLE_VALUE, &sectionSa, PAGE_READWRITE, 0, sizeof(Status), SECTION_NAME);
+        g_hWriterMutex = CreateMutexW(&mutexSa, FALSE, WRITER_MUTEX_NAME);
+        g_hChangedEvent = CreateEventW(&mutexSa, FALSE, FALSE, CHANGED_EVENT_NAME);
+        LocalFree(pMutexSd);
+        LocalFree(pSectionSd);
+
+        if (!g_hSection || !g_hWriterMutex || !g_hChangedEvent) {
+            LogDebug(L"StatusBlock: Creating the status section failed (Error: %d).", GetLastError());
+            Close();
+            return false;
+        }
+        if (!Map(FILE_MAP_WRITE)) return false;
+
+        // The section can outlive a previous master while a reader still holds it; start from a clean slate.
+        WriteScope write;
+        if (!write.Locked()) {
+            LogDebug(L"StatusBlock: Writer lock unavailable. Not publishing.");
+            Close();
+            return false;
+        }
+
+        LONG sequence = g_status->Sequence;
+        ZeroMemory(g_status, sizeof(Status));
+        g_status->Sequence = sequence;
+        g_status->Magic = STATUS_MAGIC;
+        g_status->LayoutVersion = LAYOUT_VERSION;
+        g_status->MasterProcessId = GetCurrentProcessId();
+        g_status->MasterStartTime = CurrentFileTime();
+        g_status->ActiveSessionId = 0xFFFFFFFF;
+        return true;
+    }
+
+    bool Open() {
+        if (g_status) return true;
+
+        g_hSection = OpenFileMappingW(FILE_MAP_WRITE, FALSE, SECTION_NAME);
+        g_hWriterMutex = OpenMutexW(SYNCHRONIZE | MUTEX_MODIFY_STATE, FALSE, WRITER_MUTEX_NAME);
+        g_hChangedEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, CHANGED_EVENT_NAME);
+        if (!g_hSection || !g_hWriterMutex || !g_hChangedEvent) {
+            LogDebug(L"StatusBlock: Status section not found (Error: %d). Not publishing.", GetLastError());
+            Close();
+            return false;
+        }
+        if (!Map(FILE_MAP_WRITE)) return false;
+
+        if (g_status->Magic != STATUS_MAGIC || g_status->LayoutVersion != LAYOUT_VERSION) {
+            LogDebug(L"StatusBlock: Layout version %u does not match %u. Not publishing.", g_status->LayoutVersion, LAYOUT_VERSION);
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        if (g_status) { UnmapViewOfFile(g_status); g_status = nullptr; }
+        if (g_hChangedEvent) { CloseHandle(g_hChangedEvent); g_hChangedEvent = NULL; }
+        if (g_hWriterMutex) { CloseHandle(g_hWriterMutex); g_hWriterMutex = NULL; }
+        if (g_hSection) { CloseHandle(g_hSection); g_hSection = NULL; }
+    }
+
+    void PublishActiveSession(DWORD sessionId) {
+        // Master-only fields: no other writer touches them, so an unlocked compare is safe.
+        if (!g_status || g_status->ActiveSessionId == sessionId) return;
+
+        WriteScope write;
+        if (write.Locked()) g_status->ActiveSessionId = sessionId;
+    }
+
+    void PublishPanel(const PanelManager::PanelState& state) {
+        if (!g_status) return;
+
+        UINT widthMm = state.HasData ? state.Dims.WidthMm : 0;
+        UINT heightMm = state.HasData ? state.Dims.HeightMm : 0;
+        if (g_status->PanelHasData == (LONG)state.HasData && g_status->PanelChangeStamp == state.ChangeStamp &&
+            g_status->PanelWidthMm == widthMm && g_status->PanelHeightMm == heightMm) {
+            return;
+        }
+
+        WriteScope write;
+        if (!write.Locked()) return;
+        g_status->PanelHasData = state.HasData;
+        g_status->PanelChangeStamp = state.ChangeStamp;
+        g_status->PanelWidthMm = widthMm;
+        g_status->PanelHeightMm = heightMm;
+    }
+
+    // Caller holds the writer lock. Reuses the session's entry, then a free one, then the oldest exited one.
+    WorkerStatus* FindWorker(DWORD sessionId) {
+        WorkerStatus* freeEntry = nullptr;
+        WorkerStatus* oldestExited = nullptr;
+        for (auto& worker : g_status->Workers) {
+            if (worker.State == WorkerState::Unused) {
+                if (!freeEntry) freeEntry = &worker;
+                continue;
+            }
+            if (worker.SessionId == sessionId) return &worker;
+            if (worker.State == WorkerState::Exited && (!oldestExited || worker.ExitTime < oldestExited->ExitTime)) {
+                oldestExited = &worker;
+            }
+        }
+
+        WorkerStatus* entry = freeEntry ? freeEntry : oldestExited;
+        if (entry) {
+            *entry = {};
+            entry->SessionId = sessionId;
+        }
+        return entry;
+    }
+
+    void PublishWorkerLaunched(DWORD sessionId, DWORD processId) {
+        WriteScope write;
+        if (!write.Locked()) return;
+
+        WorkerStatus* worker = FindWorker(sessionId);
+        if (!worker) return;
+        worker->ProcessId = processId;
+        worker->State = WorkerState::Launching;
+        worker->LaunchTime = CurrentFileTime();
+        worker->ExitTime = 0;
+        worker->ExitCode = 0;
+        worker->PrivateBytes = 0;
+        worker->WorkingSetBytes = 0;
+    }
+
+    void PublishWorkerState(DWORD sessionId, WorkerState state) {
+        WriteScope write;
+        if (!write.Locked()) return;
+
+        WorkerStatus* worker = FindWorker(sessionId);
+        if (worker) worker->State = state;
+    }
+
+    void PublishWorkerExited(DWORD sessionId, DWORD exitCode, ULONG crashCount, bool backoff) {
+        WriteScope write;
+        if (!write.Locked()) return;
+
+        WorkerStatus* worker = FindWorker(sessionId);
+        if (!worker) return;
+        // Launching again right away: the state machine moves on with the next launch.
+        worker->State = backoff ? WorkerState::Backoff : WorkerState::Exited;
+        worker->CrashCount = crashCount;
+        worker->ExitTime = CurrentFileTime();
+        worker->ExitCode = exitCode;
+    }
+
+    void PublishMasterFootprint(ULONGLONG privateBytes, ULONGLONG workingSetBytes) {
+        WriteScope write;
+        if (!write.Locked()) return;
+        g_status->MasterPrivateBytes = privateBytes;
+        g_status->MasterWorkingSetBytes = workingSetBytes;
+    }
+
+    void PublishWorkerFootprint(DWORD sessionId, ULONGLONG privateBytes, ULONGLONG workingSetBytes) {
+        WriteScope write;
+        if (!write.Locked()) return;
+
+        WorkerStatus* worker = FindWorker(sessionId);
+        if (!worker) return;
+        worker->PrivateBytes = privateBytes;
+        worker->WorkingSetBytes = workingSetBytes;
+    }
+
+    bool IsActiveDesktopState(DesktopState state) {
+        return state == DesktopState::Probing || state == DesktopState::Ready;
+    }
+
+    // Caller holds the writer lock. Reuses the desktop's entry, then a free one, then an inactive one.
+    DesktopStatus* FindDesktop(DWORD sessionId, LPCWSTR desktopName) {
+        DesktopStatus* freeEntry = nullptr;
+        DesktopStatus* inactiveEntry = nullptr;
+        for (auto& desktop : g_status->Desktops) {
+            if (desktop.State == DesktopState::Unused) {
+                if (!freeEntry) freeEntry = &desktop;
+                continue;
+            }
+            if (desktop.SessionId == sessionId && _wcsicmp(desktop.Name, desktopName) == 0) return &desktop;
+            if (!inactiveEntry && !IsActiveDesktopState(desktop.State)) inactiveEntry = &desktop;
+        }
+
+        DesktopStatus* entry = freeEntry ? freeEntry : inactiveEntry;
+        if (entry) {
+            *entry = {};
+            entry->SessionId = sessionId;
+            wcsncpy_s(entry->Name, desktopName, _TRUNCATE);
+        }
+        return entry;
+    }
+
+    void PublishDesktop(DWORD sessionId, LPCWSTR desktopName, DesktopState state, ULONG probeAttempts, DWORD lastError) {
+        WriteScope write;
+        if (!write.Locked()) return;
+
+        DesktopStatus* desktop = FindDesktop(sessionId, desktopName);
+        if (!desktop) return;
+
+        ULONGLONG now = CurrentFileTime();
+        if (state == DesktopState::Probing && desktop->State != DesktopState::Probing) {
+            desktop->ProbeStartTime = now;
+            desktop->ReadyTime = 0;
+        }
+        if (state == DesktopState::Ready && desktop->State != DesktopState::Ready) desktop->ReadyTime = now;
+
+        bool transitioned = (desktop->State != state);
+        desktop->State = state;
+        desktop->ProbeAttempts = probeAttempts;
+        desktop->LastError = lastError;
+        if (transitioned) SetEvent(g_hChangedEvent);
+    }
+
+    void PublishStopped(DWORD sessionId, LPCWSTR desktopName) {
+        WriteScope write;
+        if (!write.Locked()) return;
+
+        bool transitioned = false;
+        for (auto& desktop : g_status->Desktops) {
+            if (desktop.SessionId != sessionId || !IsActiveDesktopState(desktop.State)) continue;
+            if (desktopName && _wcsicmp(desktop.Name, desktopName) != 0) continue;
+            desktop.State = DesktopState::Stopped;
+            transitioned = true;
+        }
+        if (transitioned) SetEvent(g_hChangedEvent);
+    }
+
+    HANDLE ChangedEvent() {
+        return g_status ? g_hChangedEvent : NULL;
+    }
+
+    // Seqlock read straight from the writable view, so the query does not bump the sequence.
+    DesktopState GetSessionProgress(DWORD sessionId) {
+        if (!g_status) return DesktopState::Unused;
+
+        for (int attempt = 0; attempt < READ_MAX_ATTEMPTS; ++attempt) {
+            LONG before = ReadAcquire(&g_status->Sequence);
+            if (before & 1) {
+                YieldProcessor();
+                continue;
+            }
+
+            DesktopState progress = DesktopState::Unused;
+            for (const auto& desktop : g_status->Desktops) {
+                if (desktop.SessionId != sessionId) continue;
+                if (desktop.State == DesktopState::Ready) progress = DesktopState::Ready;
+                else if (desktop.State == DesktopState::Probing && progress != DesktopState::Ready) progress = DesktopState::Probing;
+            }
+
+            MemoryBarrier();
+            if (ReadAcquire(&g_status->Sequence) == before) return progress;
+        }
+        return DesktopState::Unused;
+    }
+
+    bool Reader::Open() {
+        if (m_view) return true;
+
+        m_hSection = OpenFileMappingW(FILE_MAP_READ, FALSE, SECTION_NAME);
+        if (!m_hSection) return false;
+
+        m_view = static_cast<const Status*>(MapViewOfFile(m_hSection, FILE_MAP_READ, 0, 0, sizeof(Status)));
+        if (!m_view) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Reader::Close() {
+        if (m_view) { UnmapViewOfFile(m_view); m_view = nullptr; }
+        if (m_hSection) { CloseHandle(m_hSection); m_hSection = NULL; }
+    }
+
+    bool Reader::Read(Status& snapshot) const {
+        if (!m_view) return false;
+
+        for (int attempt = 0; attempt < READ_MAX_ATTEMPTS; ++attempt) {
+            LONG before = ReadAcquire(&m_view->Sequence);
+            if (before & 1) {
+                YieldProcessor();
+                continue;
+            }
+
+            memcpy(&snapshot, (const void*)m_view, sizeof(Status));
+            MemoryBarrier();
+            if (ReadAcquire(&m_view->Sequence) == before) {
+                return snapshot.Magic == STATUS_MAGIC && snapshot.LayoutVersion == LAYOUT_VERSION;
+            }
+        }
+        return false;
+    }
+}
\ No newline at end of file
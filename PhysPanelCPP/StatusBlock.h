@@ -0,0 +1,147 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+#include "PanelManager.h"
+
+// Touch service status published in a named shared-memory section. The session 0 master creates it;
+// workers open it and fill in their desktops. Writers serialize on a named mutex and bump a sequence
+// counter (odd while an update is in flight), so readers take lock-free snapshots without ever
+// blocking the service.
+namespace StatusBlock {
+
+    constexpr auto SECTION_NAME = L"Global\\XFEST_TouchSvc_Status";
+    constexpr auto WRITER_MUTEX_NAME = L"Global\\XFEST_TouchSvc_Status_Lock";
+    constexpr auto CHANGED_EVENT_NAME = L"Global\\XFEST_TouchSvc_Status_Changed";
+
+    const ULONG STATUS_MAGIC = 0x58465354; // "TSFX"
+    // Bumped whenever the layout below changes; readers reject other versions.
+    const ULONG LAYOUT_VERSION = 3;
+
+    const size_t MAX_WORKERS = 16;
+    const size_t MAX_DESKTOPS = 32;
+    const size_t DESKTOP_NAME_CHARS = 32;
+
+    // Mirrors the master's per-session state machine; Exited means no worker is wanted right now.
+    enum class WorkerState : LONG { Unused = 0, Launching, Probing, Ready, Backoff, Exited };
+
+    enum class DesktopState : LONG { Unused = 0, Probing, Ready, Failed, Stopped };
+
+    // Times are UTC FILETIMEs so readers in other sessions can interpret them.
+    struct WorkerStatus {
+        DWORD SessionId;
+        DWORD ProcessId;
+        WorkerState State;
+        ULONG CrashCount;
+        ULONGLONG LaunchTime;
+        ULONGLONG ExitTime;
+        DWORD ExitCode;
+        DWORD Reserved;
+        ULONGLONG PrivateBytes;    // Published by the worker once it has settled into its ready state.
+        ULONGLONG WorkingSetBytes;
+    };
+
+    struct DesktopStatus {
+        DWORD SessionId;
+        DesktopState State;
+        ULONG ProbeAttempts;
+        DWORD LastError;
+        ULONGLONG ProbeStartTime;
+        ULONGLONG ReadyTime;
+        wchar_t Name[DESKTOP_NAME_CHARS];
+    };
+
+    struct Status {
+        ULONG Magic;
+        ULONG LayoutVersion;
+        volatile LONG Sequence;
+        DWORD MasterProcessId;
+        ULONGLONG MasterStartTime;
+        ULONGLONG UpdateTime;
+        DWORD ActiveSessionId;
+        ULONG PanelChangeStamp;
+        UINT PanelWidthMm;
+        UINT PanelHeightMm;
+        LONG PanelHasData;
+        DWORD Reserved;
+        ULONGLONG MasterPrivateBytes;
+        ULONGLONG MasterWorkingSetBytes;
+        WorkerStatus Workers[MAX_WORKERS];
+        DesktopStatus Desktops[MAX_DESKTOPS];
+    };
+
+    // Master: creates (or re-initializes) the section. Workers: open it for writing.
+    // Publishing is a no-op when neither succeeded, so the service never depends on it.
+    bool Create();
+
+    bool Open();
+
+    void Close();
+
+    void PublishActiveSession(DWORD sessionId);
+
+    void PublishPanel(const PanelManager::PanelState& state);
+
+    void PublishWorkerLaunched(DWORD sessionId, DWORD processId);
+
+    void PublishWorkerState(DWORD sessionId, WorkerState state);
+
+    void PublishWorkerExited(DWORD sessionId, DWORD exitCode, ULONG crashCount, bool backoff);
+
+    // Memory footprint of the calling master or worker process.
+    void PublishMasterFootprint(ULONGLONG privateBytes, ULONGLONG workingSetBytes);
+
+    void PublishWorkerFootprint(DWORD sessionId, ULONGLONG privateBytes, ULONGLONG workingSetBytes);
+
+    // Per-desktop probe progress, keyed by session and desktop name.
+    void PublishDesktop(DWORD sessionId, LPCWSTR desktopName, DesktopState state, ULONG probeAttempts, DWORD lastError);
+
+    // Marks one desktop (or, with no name, every desktop of the session) stopped, keeping its probe
+    // counters. The master uses the session-wide form when a worker exits without cleaning up.
+    void PublishStopped(DWORD sessionId, LPCWSTR desktopName = nullptr);
+
+    // Auto-reset, signaled whenever a desktop changes state (not on every probe attempt), so the
+    // master can advance its session state machine. NULL when the block is unavailable.
+    HANDLE ChangedEvent();
+
+    // Furthest-along desktop state of a session: Ready if any desktop is ready, else Probing if any
+    // is probing, else Unused.
+    DesktopState GetSessionProgress(DWORD sessionId);
+
+    // Read-only view for the GUI, scripts and the CLI. Keep one open to poll cheaply.
+    class Reader {
+    public:
+        Reader() = default;
+        ~Reader() { Close(); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // Fails when the service is not running.
+        bool Open();
+
+        void Close();
+
+        // Copies one consistent snapshot. Returns false when no consistent copy could be taken
+        // (a writer kept updating) or the layout version differs.
+        bool Read(Status& snapshot) const;
+
+    private:
+        HANDLE m_hSection = NULL;
+        const Status* m_view = nullptr;
+    };
+}
\ No newline at end of file
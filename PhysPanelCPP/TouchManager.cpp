@@ -18,9 +18,15 @@
 #include "TouchManager.h"
 #include <wtsapi32.h>
 #include <userenv.h>
-#include <string>
 #include <vector>
+#include <algorithm>
 #include "Utils.h"
+#include "Trace.h"
+#include "ControlService.h"
+#include "StatusBlock.h"
+#include "PowerMonitor.h"
+#include "GamepadTouch.h"
+#include "Footprint.h"
 
 #pragma comment(lib, "Wtsapi32.lib")
 #pragma comment(lib, "Userenv.lib")
@@ -29,22 +35,205 @@ namespace TouchManager {
 
     const LPCWSTR MASTER_MUTEX_NAME = L"Global\\XFEST_TouchSvc_Master_Lock";
 
+    // Desktops hosted by each session worker. The process itself is launched on the first entry.
+    const LPCWSTR TARGET_DESKTOPS[] = { L"winsta0\\default", L"winsta0\\winlogon" };
+
     typedef BOOL(NTAPI* PInitializeTouchInjection)(UINT32, DWORD);
     typedef BOOL(NTAPI* PInjectTouchInput)(UINT32, const POINTER_TOUCH_INFO*);
 
-    std::wstring BuildMutexName(DWORD sessionId, const std::wstring& desktopPathOrName) {
-        std::wstring shortName = desktopPathOrName;
-        size_t lastSlash = shortName.find_last_of(L'\\');
-        if (lastSlash != std::wstring::npos) {
-            shortName = shortName.substr(lastSlash + 1);
+    const size_t OBJECT_NAME_CHARS = 96;
+
+    void FormatDesktopMutexName(DWORD sessionId, LPCWSTR desktopPathOrName, wchar_t (&name)[OBJECT_NAME_CHARS]) {
+        LPCWSTR shortName = wcsrchr(desktopPathOrName, L'\\');
+        shortName = shortName ? shortName + 1 : desktopPathOrName;
+
+        int prefixLen = swprintf_s(name, L"Global\\XFEST_TouchSvc_Worker_%lu_", sessionId);
+        wcsncat_s(name, shortName, _TRUNCATE);
+        for (wchar_t* c = name + (prefixLen > 0 ? prefixLen : 0); *c; ++c) *c = towlower(*c);
+    }
+
+    void FormatWorkerMutexName(DWORD sessionId, wchar_t (&name)[OBJECT_NAME_CHARS]) {
+        swprintf_s(name, L"Global\\XFEST_TouchSvc_Worker_%lu", sessionId);
+    }
+
+    // Created by each session worker; the master signals it to make the worker exit for a restart.
+    void FormatRestartEventName(DWORD sessionId, wchar_t (&name)[OBJECT_NAME_CHARS]) {
+        swprintf_s(name, L"Global\\XFEST_TouchSvc_Restart_%lu", sessionId);
+    }
+
+    // Created by each session worker; the master signals it on session events (logon, unlock, connect) so
+    // desktop threads that gave up probing are started again while the worker lives.
+    void FormatRespawnEventName(DWORD sessionId, wchar_t (&name)[OBJECT_NAME_CHARS]) {
+        swprintf_s(name, L"Global\\XFEST_TouchSvc_Respawn_%lu", sessionId);
+    }
+
+    // Created by the master per session; signaled while the session can take input (connected, not
+    // switched away from). Workers pause probing while it is reset.
+    void FormatSessionActiveEventName(DWORD sessionId, wchar_t (&name)[OBJECT_NAME_CHARS]) {
+        swprintf_s(name, L"Global\\XFEST_TouchSvc_Active_%lu", sessionId);
+    }
+
+    // Resolved once per worker process and shared by every desktop thread.
+    struct TouchApi {
+        PInitializeTouchInjection InitializeTouchInjection = nullptr;
+        PInjectTouchInput InjectTouchInput = nullptr;
+    };
+
+    struct DesktopThreadContext {
+        LPCWSTR desktopPath;
+        const TouchApi* api;
+        HANDLE hStopEvent;
+        HANDLE hDisplayOnEvent;     // Manual-reset, signaled while the display is on. NULL: assume on.
+        HANDLE hSessionActiveEvent; // Manual-reset, signaled while the session can take input. NULL: assume so.
+        HANDLE hReprobeEvent;       // Auto-reset, set by the worker after a wake or a session event.
+        bool gamepadTouch;          // Drive touch from controllers once injection is ready.
+        Footprint::Trimmer* footprint;
+    };
+
+    // Blocks while the display is off or the session is switched away from, since no probe can succeed
+    // then. Returns false when stopped; `paused` reports whether it had to wait at all.
+    bool WaitForInputGates(const DesktopThreadContext& ctx, bool& paused) {
+        paused = false;
+        HANDLE gates[] = { ctx.hDisplayOnEvent, ctx.hSessionActiveEvent };
+        for (bool closed = true; closed; ) {
+            closed = false;
+            for (HANDLE hGate : gates) {
+                if (!hGate || WaitForSingleObject(hGate, 0) == WAIT_OBJECT_0) continue;
+                closed = paused = true;
+                HANDLE handles[] = { ctx.hStopEvent, hGate };
+                if (WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) return false;
+            }
+        }
+        return true;
+    }
+
+    enum class ProbeErrorClass {
+        Transient, // Injection stack not up yet: retry aggressively.
+        Blocked,   // Desktop not accepting input right now (e.g. not the input desktop): retry slowly.
+        Fatal      // Retrying cannot help.
+    };
+
+    enum class ProbeOutcome { Ready, Fatal, TimedOut, Stopped };
+
+    ProbeErrorClass ClassifyProbeError(DWORD dwErr) {
+        switch (dwErr) {
+        // ERROR_INVALID_PARAMETER is deliberately left transient: InjectTouchInput also returns it for a stale
+        // or off-screen pointer while the desktop is switching.
+        case ERROR_NOT_SUPPORTED:
+        case ERROR_CALL_NOT_IMPLEMENTED:
+        case ERROR_INVALID_FUNCTION:
+        case ERROR_PROC_NOT_FOUND:
+            return ProbeErrorClass::Fatal;
+        case ERROR_ACCESS_DENIED:
+            return ProbeErrorClass::Blocked;
+        default:
+            return ProbeErrorClass::Transient;
+        }
+    }
+
+    const DWORD PROBE_INITIAL_DELAY_MS = 10;
+    const DWORD PROBE_MAX_DELAY_MS = 1000;
+    const DWORD PROBE_BLOCKED_DELAY_MS = 1000;
+    const ULONGLONG PROBE_DEADLINE_MS = 30000;
+
+    // Readiness detector for InjectTouchInput: starts with a short interval and backs off exponentially
+    // (with +/-25% jitter so desktop threads do not probe in lockstep) up to PROBE_MAX_DELAY_MS.
+    // In-range hover update at (0,0): accepted once injection is ready, without producing a tap.
+    void FillProbeContact(POINTER_TOUCH_INFO& contact) {
+        contact = { 0 };
+        contact.pointerInfo.pointerType = PT_TOUCH;
+        contact.pointerInfo.pointerId = 0;
+        contact.pointerInfo.ptPixelLocation.x = 0;
+        contact.pointerInfo.ptPixelLocation.y = 0;
+        contact.pointerInfo.pointerFlags = POINTER_FLAG_UPDATE | POINTER_FLAG_INRANGE;
+        contact.touchFlags = TOUCH_FLAG_NONE;
+        contact.touchMask = TOUCH_MASK_NONE;
+    }
+
+    ProbeOutcome ProbeTouchInjection(const DesktopThreadContext& ctx, DWORD sessionId, LPCWSTR desktopName) {
+        Trace::PhaseScope trace(L"Touch", L"TouchProbe");
+        POINTER_TOUCH_INFO contact;
+        FillProbeContact(contact);
+
+        ULONGLONG start = GetTickCount64();
+        DWORD delayMs = PROBE_INITIAL_DELAY_MS;
+        ULONG seed = GetCurrentThreadId() ^ (ULONG)start;
+
+        for (int attempt = 1; ; ++attempt) {
+            if (ctx.api->InjectTouchInput(1, &contact)) {
+                StatusBlock::PublishDesktop(sessionId, desktopName, StatusBlock::DesktopState::Ready, (ULONG)attempt, ERROR_SUCCESS);
+                LogDebug(L"*** Probe SUCCESS at attempt %d after %llu ms. Touch Injection READY. ***", attempt, GetTickCount64() - start);
+                trace.SetStatus(ERROR_SUCCESS);
+                Trace::Milestone(L"Touch", L"TouchReady", (DWORD)attempt);
+                return ProbeOutcome::Ready;
+            }
+
+            DWORD dwErr = GetLastError();
+            trace.SetStatus(dwErr);
+            StatusBlock::PublishDesktop(sessionId, desktopName, StatusBlock::DesktopState::Probing, (ULONG)attempt, dwErr);
+            ProbeErrorClass errClass = ClassifyProbeError(dwErr);
+            if (errClass == ProbeErrorClass::Fatal) {
+                LogDebug(L"Probe Attempt %d failed with fatal error %d. Not retrying.", attempt, dwErr);
+                StatusBlock::PublishDesktop(sessionId, desktopName, StatusBlock::DesktopState::Failed, (ULONG)attempt, dwErr);
+                return ProbeOutcome::Fatal;
+            }
+
+            // Idle instead of spending wakeups while nothing can accept input, and do not count the
+            // pause against the deadline.
+            ULONGLONG pausedAt = GetTickCount64();
+            bool paused = false;
+            if (!WaitForInputGates(ctx, paused)) return ProbeOutcome::Stopped;
+            if (paused) {
+                LogDebug(L"Probe resumed after pausing %llu ms at attempt %d (display off or session inactive).", GetTickCount64() - pausedAt, attempt);
+                start += GetTickCount64() - pausedAt;
+                delayMs = PROBE_INITIAL_DELAY_MS;
+                continue;
+            }
+
+            ULONGLONG elapsed = GetTickCount64() - start;
+            if (elapsed >= PROBE_DEADLINE_MS) {
+                LogDebug(L"Probe deadline reached after %d attempts (last error: %d).", attempt, dwErr);
+                StatusBlock::PublishDesktop(sessionId, desktopName, StatusBlock::DesktopState::Failed, (ULONG)attempt, dwErr);
+                return ProbeOutcome::TimedOut;
+            }
+
+            DWORD baseMs = (errClass == ProbeErrorClass::Blocked) ? PROBE_BLOCKED_DELAY_MS : delayMs;
+            seed = seed * 1103515245 + 12345;
+            DWORD jitterRange = baseMs / 2;
+            DWORD sleepMs = baseMs - baseMs / 4 + (jitterRange ? (seed >> 16) % (jitterRange + 1) : 0);
+            sleepMs = (DWORD)(std::min)((ULONGLONG)sleepMs, PROBE_DEADLINE_MS - elapsed);
+
+            LogDebug(L"Probe Attempt %d failed (Error: %d, %s). Retrying in %dms...", attempt, dwErr,
+                errClass == ProbeErrorClass::Blocked ? L"blocked" : L"transient", sleepMs);
+
+            if (WaitForSingleObject(ctx.hStopEvent, sleepMs) == WAIT_OBJECT_0) return ProbeOutcome::Stopped;
+
+            if (errClass == ProbeErrorClass::Transient) {
+                delayMs = (std::min)(delayMs * 2, PROBE_MAX_DELAY_MS);
+            }
         }
+    }
 
-        for (auto& c : shortName) c = towlower(c);
+    bool InjectProbeContact() {
+        static TouchApi api;
+        static bool initialized = false;
+        if (!initialized) {
+            initialized = true;
+            HMODULE hUser32 = GetModuleHandleW(L"User32.dll");
+            if (hUser32) {
+                api.InitializeTouchInjection = (PInitializeTouchInjection)GetProcAddress(hUser32, "InitializeTouchInjection");
+                api.InjectTouchInput = (PInjectTouchInput)GetProcAddress(hUser32, "InjectTouchInput");
+            }
+            if (api.InitializeTouchInjection) api.InitializeTouchInjection(10, TOUCH_FEEDBACK_NONE);
+        }
+        if (!api.InjectTouchInput) return false;
 
-        return L"Global\\XFEST_TouchSvc_Worker_" + std::to_wstring(sessionId) + L"_" + shortName;
+        POINTER_TOUCH_INFO contact;
+        FillProbeContact(contact);
+        return api.InjectTouchInput(1, &contact) != FALSE;
     }
 
-    void RunTouchLogic() {
+    void RunTouchLogic(const DesktopThreadContext& ctx) {
         WCHAR szDesktopName[128] = { 0 };
         HDESK hDesk = GetThreadDesktop(GetCurrentThreadId());
         DWORD len = 0;
@@ -55,8 +244,9 @@ namespace TouchManager {
 
         LogDebug(L"--- RunTouchLogic() Started [Session: %d, Desktop: %s] ---", sessionId, szDesktopName);
 
-        std::wstring instanceMutexName = BuildMutexName(sessionId, szDesktopName);
-        HANDLE hInstanceMutex = CreateMutexW(NULL, TRUE, instanceMutexName.c_str());
+        wchar_t instanceMutexName[OBJECT_NAME_CHARS];
+        FormatDesktopMutexName(sessionId, szDesktopName, instanceMutexName);
+        HANDLE hInstanceMutex = CreateMutexW(NULL, TRUE, instanceMutexName);
 
         if (hInstanceMutex == NULL) {
             LogDebug(L"Error: CreateMutexW failed (Error: %d). Aborting.", GetLastError());
@@ -68,200 +258,1235 @@ namespace TouchManager {
             return;
         }
 
+        // The injection context may already be set up process-wide by another desktop thread,
+        // so a FALSE here is not fatal; the probe below is the authoritative readiness check.
+        if (ctx.api->InitializeTouchInjection(10, TOUCH_FEEDBACK_DEFAULT)) {
+            LogDebug(L"InitializeTouchInjection API returned TRUE. Starting Probe phase...");
+        }
+        else {
+            LogDebug(L"Warning: InitializeTouchInjection returned FALSE (Error: %d). Probing anyway...", GetLastError());
+        }
+
+        ProbeOutcome outcome = ProbeTouchInjection(ctx, sessionId, szDesktopName);
+        bool bProbeSucceeded = (outcome == ProbeOutcome::Ready);
+
+        if (bProbeSucceeded) {
+            // Only the default desktop reads controllers, so contacts never race between desktops.
+            GamepadTouch::Pipeline gamepad;
+            if (ctx.gamepadTouch && _wcsicmp(szDesktopName, L"Default") == 0) {
+                GamepadTouch::Config config = { hDesk, ctx.api->InjectTouchInput, ctx.hDisplayOnEvent, ctx.hSessionActiveEvent };
+                if (!gamepad.Start(config)) LogDebug(L"Warning: Gamepad touch pipeline unavailable on %s.", szDesktopName);
+            }
+            ctx.footprint->NotifyReady();
+
+            bool bRunning = true;
+            MSG msg;
+            HANDLE waitHandles[] = { ctx.hStopEvent, ctx.hReprobeEvent };
+
+            LogDebug(L"Entering message loop...");
+            while (bRunning) {
+                DWORD waitResult = MsgWaitForMultipleObjects(_countof(waitHandles), waitHandles, FALSE, INFINITE, QS_ALLINPUT);
+
+                switch (waitResult) {
+                case WAIT_OBJECT_0:
+                    LogDebug(L"Stop requested. Desktop thread shutting down.");
+                    outcome = ProbeOutcome::Stopped;
+                    bRunning = false;
+                    break;
+
+                case WAIT_OBJECT_0 + 1:
+                    // After resume (or a session event) the injection context may be stale; confirm it right away.
+                    LogDebug(L"Re-probing touch injection on %s...", szDesktopName);
+                    outcome = ProbeTouchInjection(ctx, sessionId, szDesktopName);
+                    if (outcome == ProbeOutcome::Stopped) {
+                        bRunning = false;
+                        break;
+                    }
+                    if (outcome != ProbeOutcome::Ready) {
+                        // Keep the thread (and the worker's hold on this desktop); nothing else would bring it
+                        // back while the other desktop keeps the worker alive.
+                        LogDebug(L"Re-probe did not succeed. Retrying on the next wake or session event.");
+                        break;
+                    }
+                    ctx.footprint->NotifyReady();
+                    break;
+
+                case WAIT_OBJECT_0 + 2:
+                    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+                        if (msg.message == WM_QUIT) {
+                            LogDebug(L"WM_QUIT received. Shutting down.");
+                            bRunning = false;
+                            break;
+                        }
+                        TranslateMessage(&msg);
+                        DispatchMessage(&msg);
+                    }
+                    break;
+
+                case WAIT_FAILED:
+                    LogDebug(L"MsgWaitForMultipleObjects failed (Error: %d).", GetLastError());
+                    bRunning = false;
+                    break;
+                }
+            }
+            LogDebug(L"Exiting message loop.");
+        }
+        else if (outcome != ProbeOutcome::Stopped) {
+            LogDebug(L"!!! FATAL: Probe failed (%s). Giving up on this desktop until the next session event. !!!",
+                outcome == ProbeOutcome::Fatal ? L"fatal error" : L"deadline reached");
+        }
+
+        if (outcome == ProbeOutcome::Ready || outcome == ProbeOutcome::Stopped) {
+            StatusBlock::PublishStopped(sessionId, szDesktopName);
+        }
+
+        ReleaseMutex(hInstanceMutex);
+        CloseHandle(hInstanceMutex);
+        LogDebug(L"--- RunTouchLogic() Ended [%s] ---", szDesktopName);
+    }
+
+    DWORD WINAPI DesktopThreadProc(LPVOID lpParam) {
+        auto ctx = static_cast<DesktopThreadContext*>(lpParam);
+
+        LPCWSTR desktopName = wcsrchr(ctx->desktopPath, L'\\');
+        desktopName = desktopName ? desktopName + 1 : ctx->desktopPath;
+
+        // SetThreadDesktop only works before the thread owns any windows or hooks, which holds for a fresh thread.
+        HDESK hDesk = OpenDesktopW(desktopName, 0, FALSE, GENERIC_ALL);
+        if (!hDesk) {
+            LogDebug(L"Error: OpenDesktopW(%s) failed (Error: %d).", desktopName, GetLastError());
+            return 1;
+        }
+        if (!SetThreadDesktop(hDesk)) {
+            LogDebug(L"Error: SetThreadDesktop(%s) failed (Error: %d).", desktopName, GetLastError());
+            CloseDesktop(hDesk);
+            return 1;
+        }
+
+        RunTouchLogic(*ctx);
+
+        CloseDesktop(hDesk);
+        return 0;
+    }
+
+    void PublishWorkerFootprint(const Footprint::Usage& usage) {
+        DWORD sessionId = 0;
+        ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+        StatusBlock::PublishWorkerFootprint(sessionId, usage.PrivateBytes, usage.WorkingSetBytes);
+    }
+
+    struct WakeFanout {
+        HANDLE hWakeEvent;
+        const std::vector<DesktopThreadContext>* contexts;
+        volatile LONG stopping;
+    };
+
+    // Threadpool wait on the power wake event, so the worker's main thread only waits for exit conditions.
+    VOID CALLBACK OnWorkerWake(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WAIT wait, TP_WAIT_RESULT) {
+        auto fanout = static_cast<WakeFanout*>(context);
+        if (InterlockedCompareExchange(&fanout->stopping, 0, 0)) return;
+        LogDebug(L"Wake: Asking desktop threads to re-probe.");
+        for (const auto& desktopContext : *fanout->contexts) SetEvent(desktopContext.hReprobeEvent);
+        // Teardown disarms the wait; a callback already in flight must not arm it again.
+        if (!InterlockedCompareExchange(&fanout->stopping, 0, 0)) SetThreadpoolWait(wait, fanout->hWakeEvent, NULL);
+    }
+
+    // In-session worker: one process per session hosting one thread per target desktop.
+    void RunSessionWorker(const ServiceOptions& options) {
+        DWORD sessionId = 0;
+        ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+        Trace::Milestone(L"TouchService", L"WorkerStarted", 0);
+
+        LogDebug(L"--- RunSessionWorker() Started [Session: %d] ---", sessionId);
+
+        wchar_t workerMutexName[OBJECT_NAME_CHARS];
+        FormatWorkerMutexName(sessionId, workerMutexName);
+        HANDLE hWorkerMutex = CreateMutexW(NULL, TRUE, workerMutexName);
+        if (hWorkerMutex == NULL) {
+            LogDebug(L"Error: CreateMutexW failed (Error: %d). Aborting.", GetLastError());
+            return;
+        }
+        if (GetLastError() == ERROR_ALREADY_EXISTS) {
+            LogDebug(L"Session worker already running. Aborting self.");
+            CloseHandle(hWorkerMutex);
+            return;
+        }
+
         HANDLE hMasterMutex = OpenMutexW(SYNCHRONIZE, FALSE, MASTER_MUTEX_NAME);
         if (!hMasterMutex) {
             LogDebug(L"Master mutex not found. Service stopped? Aborting worker.");
-            ReleaseMutex(hInstanceMutex);
-            CloseHandle(hInstanceMutex);
+            ReleaseMutex(hWorkerMutex);
+            CloseHandle(hWorkerMutex);
             return;
         }
         LogDebug(L"Master mutex acquired (Handle open).");
+        StatusBlock::Open();
 
         HMODULE hUser32 = LoadLibraryW(L"User32.dll");
+        TouchApi api;
         if (hUser32) {
-            auto InitializeTouchInjection = (PInitializeTouchInjection)GetProcAddress(hUser32, "InitializeTouchInjection");
-            auto InjectTouchInput = (PInjectTouchInput)GetProcAddress(hUser32, "InjectTouchInput");
-
-            if (InitializeTouchInjection && InjectTouchInput) {
-                if (InitializeTouchInjection(10, TOUCH_FEEDBACK_DEFAULT)) {
-                    LogDebug(L"InitializeTouchInjection API returned TRUE. Starting Probe phase...");
-
-                    const int MAX_RETRIES = 60;
-                    const int RETRY_DELAY_MS = 500;
-                    bool bProbeSucceeded = false;
-
-                    for (int i = 0; i < MAX_RETRIES; ++i) {
-                        POINTER_TOUCH_INFO contact = { 0 };
-                        contact.pointerInfo.pointerType = PT_TOUCH;
-                        contact.pointerInfo.pointerId = 0;
-                        contact.pointerInfo.ptPixelLocation.x = 0;
-                        contact.pointerInfo.ptPixelLocation.y = 0;
-                        contact.pointerInfo.pointerFlags = POINTER_FLAG_UPDATE | POINTER_FLAG_INRANGE;
-                        contact.touchFlags = TOUCH_FLAG_NONE;
-                        contact.touchMask = TOUCH_MASK_NONE;
-
-                        if (InjectTouchInput(1, &contact)) {
-                            LogDebug(L"*** Probe SUCCESS at attempt %d. Touch Injection READY. ***", i + 1);
-                            bProbeSucceeded = true;
-                            break;
-                        }
-                        else {
-                            DWORD dwErr = GetLastError();
-                            LogDebug(L"Probe Attempt %d/%d failed (Error: %d). Retrying in %dms...",
-                                i + 1, MAX_RETRIES, dwErr, RETRY_DELAY_MS);
-                            Sleep(RETRY_DELAY_MS);
-                        }
-                    }
+            api.InitializeTouchInjection = (PInitializeTouchInjection)GetProcAddress(hUser32, "InitializeTouchInjection");
+            api.InjectTouchInput = (PInjectTouchInput)GetProcAddress(hUser32, "InjectTouchInput");
+        }
+        else {
+            LogDebug(L"Error: Failed to load User32.dll.");
+        }
+
+        HANDLE hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        wchar_t restartEventName[OBJECT_NAME_CHARS];
+        FormatRestartEventName(sessionId, restartEventName);
+        HANDLE hRestartEvent = CreateEventW(NULL, FALSE, FALSE, restartEventName);
+        wchar_t respawnEventName[OBJECT_NAME_CHARS];
+        FormatRespawnEventName(sessionId, respawnEventName);
+        HANDLE hRespawnEvent = CreateEventW(NULL, FALSE, FALSE, respawnEventName);
+
+        Power::Monitor power;
+        bool powerAware = power.Start();
+        wchar_t sessionActiveEventName[OBJECT_NAME_CHARS];
+        FormatSessionActiveEventName(sessionId, sessionActiveEventName);
+        HANDLE hSessionActive = OpenEventW(SYNCHRONIZE, FALSE, sessionActiveEventName);
+
+        if (api.InitializeTouchInjection && api.InjectTouchInput && hStopEvent && hRestartEvent && hRespawnEvent) {
+            std::vector<DesktopThreadContext> contexts;
+            contexts.reserve(_countof(TARGET_DESKTOPS));
+            std::vector<HANDLE> waitHandles;
+            waitHandles.push_back(hMasterMutex);
+            waitHandles.push_back(hRestartEvent);
+            waitHandles.push_back(hRespawnEvent);
+            const size_t firstThreadIndex = waitHandles.size();
+            // Context index of each running desktop thread, parallel to waitHandles from firstThreadIndex.
+            std::vector<size_t> threadContexts;
+
+            Footprint::Trimmer footprint;
+            footprint.Start(PublishWorkerFootprint);
+
+            for (const auto& desktop : TARGET_DESKTOPS) {
+                HANDLE hReprobeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+                if (!hReprobeEvent) {
+                    LogDebug(L"Error: CreateEventW for %s failed (Error: %d).", desktop, GetLastError());
+                    continue;
+                }
+                contexts.push_back({ desktop, &api, hStopEvent, powerAware ? power.DisplayOnEvent() : NULL, hSessionActive, hReprobeEvent, options.GamepadTouch, &footprint });
+            }
 
-                    if (bProbeSucceeded) {
-                        bool bRunning = true;
-                        MSG msg;
-
-                        LogDebug(L"Entering message loop...");
-                        while (bRunning) {
-                            DWORD waitResult = MsgWaitForMultipleObjects(1, &hMasterMutex, FALSE, INFINITE, QS_ALLINPUT);
-
-                            switch (waitResult) {
-                            case WAIT_OBJECT_0:
-                            case WAIT_ABANDONED_0:
-                                LogDebug(L"Master service stopped/abandoned. Worker shutting down.");
-                                bRunning = false;
-                                break;
-
-                            case WAIT_OBJECT_0 + 1:
-                                while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-                                    if (msg.message == WM_QUIT) {
-                                        LogDebug(L"WM_QUIT received. Shutting down.");
-                                        bRunning = false;
-                                        break;
-                                    }
-                                    TranslateMessage(&msg);
-                                    DispatchMessage(&msg);
-                                }
-                                break;
-
-                            case WAIT_FAILED:
-                                LogDebug(L"MsgWaitForMultipleObjects failed (Error: %d).", GetLastError());
-                                bRunning = false;
-                                break;
-                            }
+            auto startDesktopThread = [&](size_t index) {
+                HANDLE hThread = CreateThread(NULL, 0, DesktopThreadProc, &contexts[index], 0, NULL);
+                if (hThread) {
+                    waitHandles.push_back(hThread);
+                    threadContexts.push_back(index);
+                }
+                else {
+                    LogDebug(L"Error: CreateThread for %s failed (Error: %d).", contexts[index].desktopPath, GetLastError());
+                }
+            };
+            for (size_t i = 0; i < contexts.size(); ++i) startDesktopThread(i);
+
+            // The contexts are complete and never reallocate from here on.
+            WakeFanout fanout = { power.WakeEvent(), &contexts, 0 };
+            PTP_WAIT wakeWait = powerAware ? CreateThreadpoolWait(OnWorkerWake, &fanout, NULL) : NULL;
+            if (wakeWait) SetThreadpoolWait(wakeWait, fanout.hWakeEvent, NULL);
+
+            // Run until the master goes away, a restart is requested or every desktop thread has given up.
+            while (waitHandles.size() > firstThreadIndex) {
+                DWORD waitResult = WaitForMultipleObjects((DWORD)waitHandles.size(), waitHandles.data(), FALSE, INFINITE);
+
+                if (waitResult == WAIT_OBJECT_0 || waitResult == WAIT_ABANDONED_0) {
+                    LogDebug(L"Master service stopped/abandoned. Worker shutting down.");
+                    if (waitResult == WAIT_OBJECT_0) ReleaseMutex(hMasterMutex);
+                    break;
+                }
+                if (waitResult == WAIT_OBJECT_0 + 1) {
+                    LogDebug(L"Restart requested by master. Worker shutting down.");
+                    break;
+                }
+                if (waitResult == WAIT_OBJECT_0 + 2) {
+                    // A session event: desktops whose probe gave up (e.g. winlogon timing out while the user
+                    // sat on Default) get a fresh thread now that input may be possible again.
+                    // Running threads re-probe, which recovers one whose re-probe after a wake failed.
+                    for (size_t i = 0; i < contexts.size(); ++i) {
+                        if (std::find(threadContexts.begin(), threadContexts.end(), i) != threadContexts.end()) {
+                            SetEvent(contexts[i].hReprobeEvent);
+                            continue;
                         }
-                        LogDebug(L"Exiting message loop.");
-                    }
-                    else {
-                        LogDebug(L"!!! FATAL: Probe failed after %d attempts. Giving up on this session instance. !!!", MAX_RETRIES);
+                        LogDebug(L"Session event: Restarting desktop thread for %s.", contexts[i].desktopPath);
+                        startDesktopThread(i);
                     }
+                    continue;
                 }
-                else {
-                    LogDebug(L"Error: InitializeTouchInjection returned FALSE (Error: %d).", GetLastError());
+                if (waitResult >= WAIT_OBJECT_0 + firstThreadIndex && waitResult < WAIT_OBJECT_0 + waitHandles.size()) {
+                    size_t index = waitResult - WAIT_OBJECT_0;
+                    CloseHandle(waitHandles[index]);
+                    waitHandles.erase(waitHandles.begin() + index);
+                    threadContexts.erase(threadContexts.begin() + (index - firstThreadIndex));
+                    continue;
                 }
+
+                LogDebug(L"WaitForMultipleObjects failed (Error: %d).", GetLastError());
+                break;
             }
-            else {
-                LogDebug(L"Error: Failed to GetProcAddress for Touch APIs.");
+
+            if (wakeWait) {
+                InterlockedExchange(&fanout.stopping, 1);
+                SetThreadpoolWait(wakeWait, NULL, NULL);
+                WaitForThreadpoolWaitCallbacks(wakeWait, TRUE);
+                // Disarm and drain again in case a callback re-armed between the first disarm and the flag check.
+                SetThreadpoolWait(wakeWait, NULL, NULL);
+                WaitForThreadpoolWaitCallbacks(wakeWait, TRUE);
+                CloseThreadpoolWait(wakeWait);
             }
-            FreeLibrary(hUser32);
+            SetEvent(hStopEvent);
+            for (size_t i = firstThreadIndex; i < waitHandles.size(); ++i) {
+                WaitForSingleObject(waitHandles[i], INFINITE);
+                CloseHandle(waitHandles[i]);
+            }
+            footprint.Stop();
+            for (const auto& context : contexts) CloseHandle(context.hReprobeEvent);
         }
         else {
-            LogDebug(L"Error: Failed to load User32.dll.");
+            LogDebug(L"Error: Failed to GetProcAddress for Touch APIs.");
         }
 
-        if (hMasterMutex) CloseHandle(hMasterMutex);
-        ReleaseMutex(hInstanceMutex);
-        CloseHandle(hInstanceMutex);
-        LogDebug(L"--- RunTouchLogic() Ended ---");
+        if (hSessionActive) CloseHandle(hSessionActive);
+        if (hRespawnEvent) CloseHandle(hRespawnEvent);
+        if (hRestartEvent) CloseHandle(hRestartEvent);
+        if (hStopEvent) CloseHandle(hStopEvent);
+        if (hUser32) FreeLibrary(hUser32);
+        StatusBlock::Close();
+        CloseHandle(hMasterMutex);
+        ReleaseMutex(hWorkerMutex);
+        CloseHandle(hWorkerMutex);
+        LogDebug(L"--- RunSessionWorker() Ended ---");
     }
 
-    bool IsWorkerRunning(DWORD sessionId, LPCWSTR lpDesktop) {
-        std::wstring mutexName = BuildMutexName(sessionId, lpDesktop);
-        HANDLE hMutex = OpenMutexW(SYNCHRONIZE, FALSE, mutexName.c_str());
-        if (hMutex) {
-            CloseHandle(hMutex);
-            return true;
+    // Per-session worker lifecycle, driven by the master:
+    // Idle -> Launching (process created) -> Probing (a desktop reported a failed probe) -> Ready (a desktop
+    // accepted input). An exit returns to Idle and relaunches at once, or parks in Backoff during a crash loop.
+    enum class SessionState { Idle, Launching, Probing, Ready, Backoff };
+
+    // Per-session worker bookkeeping for the master. Names are formatted once when a session is first
+    // seen, and the worker's process handle is kept so liveness is a zero-timeout wait and a crash wakes
+    // the master immediately. Launches and handle closes happen only on the master thread; the control
+    // pipe thread reads slots under the same lock.
+    struct WorkerSlot {
+        DWORD SessionId;
+        wchar_t WorkerMutexName[OBJECT_NAME_CHARS];
+        wchar_t RestartEventName[OBJECT_NAME_CHARS];
+        HANDLE hProcess;
+        HANDLE hSessionActive;
+        ULONGLONG LaunchTick;
+        ULONGLONG RespawnNotBefore;
+        ULONG CrashCount;
+        SessionState State;
+        bool Wanted; // The session exists and should host a worker, including while switched away from.
+        bool RestartRequested;
+    };
+
+    const size_t MAX_WORKER_SLOTS = 16;
+    WorkerSlot g_workerSlots[MAX_WORKER_SLOTS] = {};
+    size_t g_workerSlotCount = 0;
+    SRWLOCK g_workerSlotLock = SRWLOCK_INIT;
+
+    // Set when the tracked process set changes or the control pipe asks for a launch, so the master
+    // rebuilds its wait set.
+    HANDLE g_hWorkerSetChanged = NULL;
+    volatile LONG g_ensureRequested = 0;
+
+    // Signaled on every panel dimension publish so the master can refresh the status block.
+    HANDLE g_hPanelChanged = NULL;
+
+    // A worker that exits sooner than this after launch counts as a crash for backoff purposes.
+    const ULONGLONG WORKER_STABLE_UPTIME_MS = 30000;
+    const DWORD RESPAWN_BASE_DELAY_MS = 1000;
+    const DWORD RESPAWN_MAX_DELAY_MS = 60000;
+
+    // Caller holds g_workerSlotLock (shared is enough). Lookup only: never allocates a slot or creates
+    // session objects, so pure queries (the control pipe, bench) leave the table alone.
+    WorkerSlot* FindWorkerSlot(DWORD sessionId) {
+        for (size_t i = 0; i < g_workerSlotCount; ++i) {
+            if (g_workerSlots[i].SessionId == sessionId) return &g_workerSlots[i];
+        }
+        return nullptr;
+    }
+
+    // Master only: session tracking and the launch path. Caller holds g_workerSlotLock exclusively.
+    // Returns nullptr only when every slot belongs to a session that is still wanted or has a live process.
+    WorkerSlot* GetWorkerSlot(DWORD sessionId) {
+        if (WorkerSlot* existing = FindWorkerSlot(sessionId)) return existing;
+
+        WorkerSlot* slot = nullptr;
+        if (g_workerSlotCount < MAX_WORKER_SLOTS) {
+            slot = &g_workerSlots[g_workerSlotCount++];
         }
-        return false;
+        else {
+            for (size_t i = 0; i < MAX_WORKER_SLOTS && !slot; ++i) {
+                if (!g_workerSlots[i].hProcess && !g_workerSlots[i].Wanted) slot = &g_workerSlots[i];
+            }
+            if (!slot) return nullptr;
+            if (slot->hSessionActive) CloseHandle(slot->hSessionActive);
+        }
+
+        *slot = {};
+        slot->SessionId = sessionId;
+        FormatWorkerMutexName(sessionId, slot->WorkerMutexName);
+        FormatRestartEventName(sessionId, slot->RestartEventName);
+
+        wchar_t sessionActiveEventName[OBJECT_NAME_CHARS];
+        FormatSessionActiveEventName(sessionId, sessionActiveEventName);
+        slot->hSessionActive = CreateEventW(NULL, TRUE, FALSE, sessionActiveEventName);
+        return slot;
+    }
+
+    bool IsWorkerRunning(DWORD sessionId) {
+        AcquireSRWLockShared(&g_workerSlotLock);
+        WorkerSlot* slot = FindWorkerSlot(sessionId);
+        if (slot && slot->hProcess) {
+            bool running = (WaitForSingleObject(slot->hProcess, 0) == WAIT_TIMEOUT);
+            ReleaseSRWLockShared(&g_workerSlotLock);
+            return running;
+        }
+        ReleaseSRWLockShared(&g_workerSlotLock);
+
+        // Untracked (another process, or nothing launched yet): fall back to the worker's session mutex.
+        wchar_t workerMutexName[OBJECT_NAME_CHARS];
+        FormatWorkerMutexName(sessionId, workerMutexName);
+        HANDLE hMutex = OpenMutexW(SYNCHRONIZE, FALSE, workerMutexName);
+        if (!hMutex) return false;
+        CloseHandle(hMutex);
+        return true;
     }
 
-    bool LaunchAsSystemInSession(DWORD targetSessionId, LPCWSTR lpDesktop) {
+    // Formatted once by the master; CreateProcessAsUserW may write to its command line argument,
+    // so each launch works on a stack copy.
+    wchar_t g_workerImagePath[MAX_PATH] = {};
+    wchar_t g_workerCommandLine[MAX_PATH + 48] = {};
+
+    void InitializeLaunchCommandLine(const ServiceOptions& options) {
+        GetModuleFileNameW(NULL, g_workerImagePath, MAX_PATH);
+        swprintf_s(g_workerCommandLine, L"\"%s\" touchservice%s", g_workerImagePath, options.GamepadTouch ? L" --gamepad-touch" : L"");
+    }
+
+    // Primary token and environment block for launching into one session. CreateEnvironmentBlock loads
+    // profile data and dominates launch cost, so both are built once per session, reused for respawns
+    // and released only when the session logs off. Master thread only, like every launch.
+    struct LaunchContext {
+        DWORD SessionId;
+        HANDLE hToken;
+        LPVOID pEnvironment;
+    };
+
+    LaunchContext g_launchContexts[MAX_WORKER_SLOTS] = {};
+
+    void DestroyLaunchContext(LaunchContext& ctx) {
+        if (ctx.pEnvironment) DestroyEnvironmentBlock(ctx.pEnvironment);
+        if (ctx.hToken) CloseHandle(ctx.hToken);
+        ctx = {};
+    }
+
+    bool BuildLaunchContext(DWORD targetSessionId, LaunchContext& ctx) {
+        Trace::PhaseScope trace(L"TouchService", L"BuildLaunchContext");
         HANDLE hCurrentToken = nullptr;
         HANDLE hTokenDup = nullptr;
         LPVOID pEnv = nullptr;
-        bool result = false;
-        PROCESS_INFORMATION pi = { 0 };
-        STARTUPINFOW si = { sizeof(si) };
-
-        LogDebug(L"Launching in Session %d on Desktop %s...", targetSessionId, lpDesktop);
 
         if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ALL_ACCESS, &hCurrentToken)) {
             LogDebug(L"Launch failed: OpenProcessToken error %d", GetLastError());
+            trace.SetStatus(ERROR_GEN_FAILURE);
             return false;
         }
 
-        if (!DuplicateTokenEx(hCurrentToken, MAXIMUM_ALLOWED, NULL, SecurityIdentification, TokenPrimary, &hTokenDup)) {
-            LogDebug(L"Launch failed: DuplicateTokenEx error %d", GetLastError());
-            CloseHandle(hCurrentToken);
+        BOOL duplicated = DuplicateTokenEx(hCurrentToken, MAXIMUM_ALLOWED, NULL, SecurityIdentification, TokenPrimary, &hTokenDup);
+        if (!duplicated) LogDebug(L"Launch failed: DuplicateTokenEx error %d", GetLastError());
+        CloseHandle(hCurrentToken);
+        if (!duplicated) {
+            trace.SetStatus(ERROR_GEN_FAILURE);
             return false;
         }
 
         if (!SetTokenInformation(hTokenDup, TokenSessionId, &targetSessionId, sizeof(DWORD))) {
             LogDebug(L"Launch failed: SetTokenInformation error %d (Need SE_TCB_NAME?)", GetLastError());
             CloseHandle(hTokenDup);
-            CloseHandle(hCurrentToken);
+            trace.SetStatus(ERROR_GEN_FAILURE);
+            return false;
+        }
+
+        if (!CreateEnvironmentBlock(&pEnv, hTokenDup, FALSE)) {
+            LogDebug(L"Launch failed: CreateEnvironmentBlock error %d", GetLastError());
+            CloseHandle(hTokenDup);
+            trace.SetStatus(ERROR_GEN_FAILURE);
             return false;
         }
 
-        if (CreateEnvironmentBlock(&pEnv, hTokenDup, FALSE)) {
+        ctx.SessionId = targetSessionId;
+        ctx.hToken = hTokenDup;
+        ctx.pEnvironment = pEnv;
+        return true;
+    }
 
-            si.lpDesktop = (LPWSTR)lpDesktop;
+    // Returns the session's cached context, building it on first use. When the cache is full of other
+    // sessions the context is built into 'uncached' instead and the caller destroys it after the launch.
+    LaunchContext* AcquireLaunchContext(DWORD targetSessionId, LaunchContext& uncached) {
+        LaunchContext* entry = nullptr;
+        for (auto& ctx : g_launchContexts) {
+            if (ctx.hToken && ctx.SessionId == targetSessionId) return &ctx;
+            if (!ctx.hToken && !entry) entry = &ctx;
+        }
 
-            WCHAR szPath[MAX_PATH];
-            GetModuleFileNameW(NULL, szPath, MAX_PATH);
+        if (!entry) entry = &uncached;
+        return BuildLaunchContext(targetSessionId, *entry) ? entry : nullptr;
+    }
 
-            std::wstring cmdLineStr = std::wstring(L"\"") + szPath + L"\" touchservice";
-            std::vector<wchar_t> cmdLineMutable(cmdLineStr.begin(), cmdLineStr.end());
-            cmdLineMutable.push_back(0);
+    void ReleaseLaunchContext(DWORD sessionId) {
+        for (auto& ctx : g_launchContexts) {
+            if (ctx.hToken && ctx.SessionId == sessionId) {
+                LogDebug(L"Monitor: Released launch context for Session %d.", sessionId);
+                DestroyLaunchContext(ctx);
+            }
+        }
+    }
 
-            if (CreateProcessAsUserW(
-                hTokenDup,
-                szPath,
-                cmdLineMutable.data(),
-                NULL, NULL, FALSE,
-                CREATE_UNICODE_ENVIRONMENT,
-                pEnv,
-                NULL,
-                &si, &pi
-            )) {
-                LogDebug(L"SUCCESS: Launched PID: %d in Session %d on %s", pi.dwProcessId, targetSessionId, lpDesktop);
+    void ReleaseAllLaunchContexts() {
+        for (auto& ctx : g_launchContexts) DestroyLaunchContext(ctx);
+    }
 
-                CloseHandle(pi.hProcess);
-                CloseHandle(pi.hThread);
-                result = true;
+    bool LaunchAsSystemInSession(DWORD targetSessionId, LPCWSTR lpDesktop, HANDLE* phProcess) {
+        bool result = false;
+        PROCESS_INFORMATION pi = { 0 };
+        STARTUPINFOW si = { sizeof(si) };
+
+        Trace::PhaseScope trace(L"TouchService", L"LaunchWorker");
+        LogDebug(L"Launching in Session %d on Desktop %s...", targetSessionId, lpDesktop);
+
+        LaunchContext uncached = {};
+        LaunchContext* ctx = AcquireLaunchContext(targetSessionId, uncached);
+        if (!ctx) {
+            trace.SetStatus(ERROR_GEN_FAILURE);
+            return false;
+        }
+
+        si.lpDesktop = (LPWSTR)lpDesktop;
+
+        wchar_t cmdLine[_countof(g_workerCommandLine)];
+        wcscpy_s(cmdLine, g_workerCommandLine);
+
+        if (CreateProcessAsUserW(
+            ctx->hToken,
+            g_workerImagePath,
+            cmdLine,
+            NULL, NULL, FALSE,
+            CREATE_UNICODE_ENVIRONMENT,
+            ctx->pEnvironment,
+            NULL,
+            &si, &pi
+        )) {
+            LogDebug(L"SUCCESS: Launched PID: %d in Session %d on %s", pi.dwProcessId, targetSessionId, lpDesktop);
+
+            if (phProcess) {
+                *phProcess = pi.hProcess;
             }
             else {
-                LogDebug(L"Launch failed: CreateProcessAsUserW error %d", GetLastError());
+                CloseHandle(pi.hProcess);
             }
-
-            DestroyEnvironmentBlock(pEnv);
+            CloseHandle(pi.hThread);
+            result = true;
         }
         else {
-            LogDebug(L"Launch failed: CreateEnvironmentBlock error %d", GetLastError());
+            LogDebug(L"Launch failed: CreateProcessAsUserW error %d", GetLastError());
+            // Do not keep retrying with a context that may have gone stale; the next launch rebuilds it.
+            DestroyLaunchContext(*ctx);
         }
 
-        if (hTokenDup) CloseHandle(hTokenDup);
-        if (hCurrentToken) CloseHandle(hCurrentToken);
+        DestroyLaunchContext(uncached);
 
+        trace.SetStatus(result ? ERROR_SUCCESS : ERROR_GEN_FAILURE);
         return result;
     }
 
-    int RunService() {
+    constexpr auto MASTER_WINDOW_CLASS = L"XFEST_TouchSvc_Master";
+    constexpr auto TERMSRV_READY_EVENT_NAME = L"Global\\TermSrvReadyEvent";
+    const DWORD MASTER_WTS_EVENT_MASK = WTS_EVENT_CONNECT | WTS_EVENT_DISCONNECT | WTS_EVENT_LOGON |
+        WTS_EVENT_LOGOFF | WTS_EVENT_STATECHANGE;
+    const UINT_PTR DEBOUNCE_TIMER_ID = 1;
+    const UINT WTS_DEBOUNCE_MS = 500;
+    const DWORD TERMSRV_READY_TIMEOUT_MS = 60000;
+    const UINT_PTR RESPAWN_TIMER_ID = 2;
+
+    bool IsInteractiveSessionId(DWORD sessionId) {
+        return sessionId != 0xFFFFFFFF && sessionId != 0;
+    }
+
+    // Only events that change whether a session needs a worker or can take input are worth a wakeup.
+    bool IsRelevantSessionEvent(WPARAM reason) {
+        switch (reason) {
+        case WTS_CONSOLE_CONNECT:
+        case WTS_CONSOLE_DISCONNECT:
+        case WTS_REMOTE_CONNECT:
+        case WTS_REMOTE_DISCONNECT:
+        case WTS_SESSION_LOGON:
+        case WTS_SESSION_LOGOFF:
+        case WTS_SESSION_UNLOCK:
+        case WTS_SESSION_TERMINATE:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Disconnected sessions (fast user switching) keep their worker so switching back is instant;
+    // they just cannot take input until reconnected.
+    bool IsWantedConnectState(WTS_CONNECTSTATE_CLASS state) {
+        switch (state) {
+        case WTSActive:
+        case WTSConnected:
+        case WTSConnectQuery:
+        case WTSShadow:
+        case WTSDisconnected:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    StatusBlock::WorkerState ToWorkerState(SessionState state) {
+        switch (state) {
+        case SessionState::Launching: return StatusBlock::WorkerState::Launching;
+        case SessionState::Probing: return StatusBlock::WorkerState::Probing;
+        case SessionState::Ready: return StatusBlock::WorkerState::Ready;
+        case SessionState::Backoff: return StatusBlock::WorkerState::Backoff;
+        default: return StatusBlock::WorkerState::Exited;
+        }
+    }
+
+    // Records whether a session should host a worker and whether it can take input right now.
+    // WTSDown is used for sessions that are logging off or gone.
+    void UpdateSession(DWORD sessionId, WTS_CONNECTSTATE_CLASS state) {
+        if (!IsInteractiveSessionId(sessionId)) return;
+
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        WorkerSlot* slot = GetWorkerSlot(sessionId);
+        bool wasWanted = false;
+        if (slot) {
+            wasWanted = slot->Wanted;
+            slot->Wanted = IsWantedConnectState(state);
+            if (slot->hSessionActive) {
+                if (slot->Wanted && state != WTSDisconnected) SetEvent(slot->hSessionActive);
+                else ResetEvent(slot->hSessionActive);
+            }
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+
+        if (slot && wasWanted != slot->Wanted) {
+            LogDebug(L"Monitor: Session %d %s (connect state %d).", sessionId, slot->Wanted ? L"tracked" : L"released", (int)state);
+        }
+    }
+
+    void RefreshSession(DWORD sessionId) {
+        WTS_CONNECTSTATE_CLASS* pState = nullptr;
+        DWORD bytes = 0;
+        WTS_CONNECTSTATE_CLASS state = WTSDown;
+        if (WTSQuerySessionInformationW(WTS_CURRENT_SERVER_HANDLE, sessionId, WTSConnectState, reinterpret_cast<LPWSTR*>(&pState), &bytes)) {
+            if (pState && bytes >= sizeof(*pState)) state = *pState;
+            WTSFreeMemory(pState);
+        }
+        UpdateSession(sessionId, state);
+    }
+
+    // Startup (and the fallback loop, which has no per-session events): one pass over every session.
+    void EnumerateSessions() {
+        Trace::PhaseScope trace(L"TouchService", L"EnumerateSessions");
+        PWTS_SESSION_INFOW pSessions = nullptr;
+        DWORD count = 0;
+        if (!WTSEnumerateSessionsW(WTS_CURRENT_SERVER_HANDLE, 0, 1, &pSessions, &count)) {
+            LogDebug(L"Monitor: WTSEnumerateSessionsW failed (Error: %d). Tracking the console session only.", GetLastError());
+            trace.SetStatus(GetLastError());
+            RefreshSession(WTSGetActiveConsoleSessionId());
+            return;
+        }
+
+        for (DWORD i = 0; i < count; ++i) {
+            UpdateSession(pSessions[i].SessionId, pSessions[i].State);
+        }
+
+        // Tracked sessions missing from the enumeration have ended.
+        DWORD goneIds[MAX_WORKER_SLOTS];
+        DWORD goneCount = 0;
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        for (size_t slot = 0; slot < g_workerSlotCount; ++slot) {
+            if (!g_workerSlots[slot].Wanted) continue;
+            bool present = false;
+            for (DWORD i = 0; i < count && !present; ++i) present = (pSessions[i].SessionId == g_workerSlots[slot].SessionId);
+            if (!present) goneIds[goneCount++] = g_workerSlots[slot].SessionId;
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+        WTSFreeMemory(pSessions);
+
+        for (DWORD i = 0; i < goneCount; ++i) {
+            UpdateSession(goneIds[i], WTSDown);
+            ReleaseLaunchContext(goneIds[i]);
+        }
+    }
+
+    // Caller holds g_workerSlotLock exclusively.
+    void SetSessionState(WorkerSlot* slot, SessionState state) {
+        if (slot->State == state) return;
+        slot->State = state;
+        StatusBlock::PublishWorkerState(slot->SessionId, ToWorkerState(state));
+        if (state == SessionState::Ready) Trace::Milestone(L"TouchService", L"SessionReady", slot->SessionId);
+    }
+
+    // Master thread only. Reaps an exited worker and returns how long to wait before relaunching it:
+    // immediately after a requested restart or a long-lived worker, exponentially longer for a crash loop.
+    DWORD OnWorkerExited(DWORD sessionId) {
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        WorkerSlot* slot = FindWorkerSlot(sessionId);
+        if (!slot || !slot->hProcess) {
+            ReleaseSRWLockExclusive(&g_workerSlotLock);
+            return 0;
+        }
+
+        DWORD exitCode = 0;
+        GetExitCodeProcess(slot->hProcess, &exitCode);
+        CloseHandle(slot->hProcess);
+        slot->hProcess = NULL;
+
+        ULONGLONG now = GetTickCount64();
+        ULONGLONG uptime = now - slot->LaunchTick;
+        DWORD delayMs = 0;
+        if (slot->RestartRequested || uptime >= WORKER_STABLE_UPTIME_MS) {
+            slot->CrashCount = 0;
+        }
+        else {
+            slot->CrashCount++;
+            ULONG shift = (std::min)(slot->CrashCount - 1, 6UL);
+            delayMs = (std::min)(RESPAWN_BASE_DELAY_MS << shift, RESPAWN_MAX_DELAY_MS);
+        }
+        slot->RestartRequested = false;
+        slot->RespawnNotBefore = now + delayMs;
+        slot->State = delayMs ? SessionState::Backoff : SessionState::Idle;
+        ULONG crashCount = slot->CrashCount;
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+
+        StatusBlock::PublishWorkerExited(sessionId, exitCode, crashCount, delayMs != 0);
+        StatusBlock::PublishStopped(sessionId);
+
+        LogDebug(L"Monitor: Worker on Session %d exited (code %u) after %llu ms. Crash streak %u, respawn in %u ms.",
+            sessionId, exitCode, uptime, crashCount, delayMs);
+        Trace::Milestone(L"TouchService", L"WorkerExited", exitCode);
+        return delayMs;
+    }
+
+    // Milliseconds left in the session's crash-loop backoff, 0 when a launch is allowed.
+    DWORD RemainingBackoff(DWORD sessionId) {
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        WorkerSlot* slot = FindWorkerSlot(sessionId);
+        ULONGLONG now = GetTickCount64();
+        DWORD remaining = (slot && slot->RespawnNotBefore > now) ? (DWORD)(slot->RespawnNotBefore - now) : 0;
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+        return remaining;
+    }
+
+    bool IsSessionWanted(DWORD sessionId) {
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        WorkerSlot* slot = FindWorkerSlot(sessionId);
+        bool wanted = slot && slot->Wanted;
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+        return wanted;
+    }
+
+    // Master thread only, like every launch, so process handles have a single owner.
+    void EnsureWorkers(DWORD sessionId) {
+        if (!IsInteractiveSessionId(sessionId)) return;
+
+        Trace::PhaseScope trace(L"TouchService", L"EnsureWorkers");
+
+        if (IsWorkerRunning(sessionId)) return;
+
+        // The event-loop fallback has no wait set, so exited workers are reaped here.
+        OnWorkerExited(sessionId);
+
+        if (!IsSessionWanted(sessionId)) return;
+
+        DWORD backoffMs = RemainingBackoff(sessionId);
+        if (backoffMs) {
+            LogDebug(L"Monitor: Worker on Session %d in crash-loop backoff (%u ms left).", sessionId, backoffMs);
+            return;
+        }
+
+        LogDebug(L"Monitor: Worker missing on Session %d. Launching...", sessionId);
+        HANDLE hProcess = NULL;
+        if (!LaunchAsSystemInSession(sessionId, TARGET_DESKTOPS[0], &hProcess)) return;
+
+        StatusBlock::PublishWorkerLaunched(sessionId, GetProcessId(hProcess));
+
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        WorkerSlot* slot = GetWorkerSlot(sessionId);
+        if (slot) {
+            slot->hProcess = hProcess;
+            slot->LaunchTick = GetTickCount64();
+            slot->State = SessionState::Launching;
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+
+        if (!slot) {
+            LogDebug(L"Monitor: No free worker slot for Session %d. Worker runs untracked.", sessionId);
+            CloseHandle(hProcess);
+        }
+        if (g_hWorkerSetChanged) SetEvent(g_hWorkerSetChanged);
+    }
+
+    // Master thread only. Ensures a worker for every session that wants one.
+    void EnsureAllWorkers() {
+        DWORD sessionIds[MAX_WORKER_SLOTS];
+        DWORD count = 0;
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        for (size_t i = 0; i < g_workerSlotCount; ++i) {
+            if (g_workerSlots[i].Wanted) sessionIds[count++] = g_workerSlots[i].SessionId;
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+
+        for (DWORD i = 0; i < count; ++i) EnsureWorkers(sessionIds[i]);
+    }
+
+    // Master thread only. Moves launched sessions to Probing or Ready from what their desktops published.
+    // Returns true when a session just became ready.
+    bool AdvanceSessionStates() {
+        bool becameReady = false;
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        for (size_t i = 0; i < g_workerSlotCount; ++i) {
+            WorkerSlot* slot = &g_workerSlots[i];
+            if (!slot->hProcess) continue;
+
+            StatusBlock::DesktopState progress = StatusBlock::GetSessionProgress(slot->SessionId);
+            if (progress == StatusBlock::DesktopState::Ready) {
+                becameReady |= (slot->State != SessionState::Ready);
+                SetSessionState(slot, SessionState::Ready);
+            }
+            else if (progress == StatusBlock::DesktopState::Probing) {
+                SetSessionState(slot, SessionState::Probing);
+            }
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+        return becameReady;
+    }
+
+    void PublishMasterFootprint(const Footprint::Usage& usage) {
+        StatusBlock::PublishMasterFootprint(usage.PrivateBytes, usage.WorkingSetBytes);
+    }
+
+    // Milliseconds until the earliest crash-loop backoff of a wanted session ends, 0 when none is pending.
+    DWORD NextBackoffExpiry() {
+        ULONGLONG now = GetTickCount64();
+        ULONGLONG earliest = 0;
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        for (size_t i = 0; i < g_workerSlotCount; ++i) {
+            const WorkerSlot& slot = g_workerSlots[i];
+            if (slot.Wanted && !slot.hProcess && slot.RespawnNotBefore > now && (!earliest || slot.RespawnNotBefore < earliest)) {
+                earliest = slot.RespawnNotBefore;
+            }
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+        return earliest ? (DWORD)(earliest - now) : 0;
+    }
+
+    // Called from the control pipe. Asks a running worker to exit (the master respawns it at once
+    // without counting a crash) or, when none is running, asks the master to launch one.
+    bool RestartWorkers(DWORD sessionId) {
+        if (!IsInteractiveSessionId(sessionId)) return false;
+
+        Trace::PhaseScope trace(L"TouchService", L"RestartWorkers");
+
+        wchar_t restartEventName[OBJECT_NAME_CHARS] = {};
+        bool tracked = false;
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        WorkerSlot* slot = FindWorkerSlot(sessionId);
+        if (slot) {
+            wcscpy_s(restartEventName, slot->RestartEventName);
+            tracked = slot->hProcess && WaitForSingleObject(slot->hProcess, 0) == WAIT_TIMEOUT;
+            slot->RestartRequested = tracked;
+            slot->RespawnNotBefore = 0;
+            slot->CrashCount = 0;
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+
+        if (tracked) {
+            HANDLE hRestartEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, restartEventName);
+            if (hRestartEvent) {
+                SetEvent(hRestartEvent);
+                CloseHandle(hRestartEvent);
+                LogDebug(L"RestartWorkers: Restart signaled on Session %d.", sessionId);
+                return true;
+            }
+            LogDebug(L"RestartWorkers: Restart event missing on Session %d (Error: %d).", sessionId, GetLastError());
+            trace.SetStatus(GetLastError());
+            return false;
+        }
+
+        // Sessions the master has not seen (e.g. the pipe names the console before its connect event) are
+        // looked up now so the ensure pass includes them.
+        RefreshSession(sessionId);
+        InterlockedExchange(&g_ensureRequested, 1);
+        return g_hWorkerSetChanged && SetEvent(g_hWorkerSetChanged);
+    }
+
+    // Master thread only. Tells a running worker to restart desktop threads that gave up; a no-op when the
+    // session has no worker (its event does not exist then).
+    void SignalDesktopRespawn(DWORD sessionId) {
+        if (!IsInteractiveSessionId(sessionId)) return;
+
+        wchar_t respawnEventName[OBJECT_NAME_CHARS];
+        FormatRespawnEventName(sessionId, respawnEventName);
+        HANDLE hRespawnEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, respawnEventName);
+        if (!hRespawnEvent) return;
+        SetEvent(hRespawnEvent);
+        CloseHandle(hRespawnEvent);
+    }
+
+    // Master thread only. Copies the tracked process handles into the wait set.
+    DWORD CollectWorkerProcesses(HANDLE* handles, DWORD* sessionIds, DWORD capacity) {
+        DWORD count = 0;
+        AcquireSRWLockExclusive(&g_workerSlotLock);
+        for (size_t i = 0; i < g_workerSlotCount && count < capacity; ++i) {
+            if (g_workerSlots[i].hProcess) {
+                handles[count] = g_workerSlots[i].hProcess;
+                sessionIds[count] = g_workerSlots[i].SessionId;
+                count++;
+            }
+        }
+        ReleaseSRWLockExclusive(&g_workerSlotLock);
+        return count;
+    }
+
+    // Session 0 master driven by WM_WTSSESSION_CHANGE. The first relevant event in a burst is handled
+    // immediately (leading edge); further events inside the debounce window collapse into a single
+    // re-check when the window closes (trailing edge).
+    class ServiceMaster {
+    public:
+        ~ServiceMaster() {
+            if (m_hwnd) {
+                if (m_notificationsRegistered) WTSUnRegisterSessionNotification(m_hwnd);
+                DestroyWindow(m_hwnd);
+            }
+        }
+
+        bool Create() {
+            if (!g_hWorkerSetChanged || !g_hPanelChanged) {
+                LogDebug(L"ServiceMaster: Wake events unavailable.");
+                return false;
+            }
+
+            HINSTANCE hInstance = GetModuleHandleW(NULL);
+            WNDCLASSEXW wc = { sizeof(wc) };
+            wc.lpfnWndProc = WndProc;
+            wc.hInstance = hInstance;
+            wc.lpszClassName = MASTER_WINDOW_CLASS;
+            if (!RegisterClassExW(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+                LogDebug(L"ServiceMaster: RegisterClassExW failed (Error: %d).", GetLastError());
+                return false;
+            }
+
+            m_hwnd = CreateWindowExW(WS_EX_TOOLWINDOW, MASTER_WINDOW_CLASS, L"", WS_POPUP,
+                0, 0, 0, 0, NULL, NULL, hInstance, this);
+            if (!m_hwnd) {
+                LogDebug(L"ServiceMaster: CreateWindowExW failed (Error: %d).", GetLastError());
+                return false;
+            }
+
+            LONGLONG registerStart = Trace::Timestamp();
+            m_notificationsRegistered = RegisterSessionNotifications();
+            Trace::Phase(L"TouchService", L"RegisterSessionNotifications", registerStart, m_notificationsRegistered ? ERROR_SUCCESS : GetLastError());
+            return m_notificationsRegistered;
+        }
+
+        void Run() {
+            if (m_panelNotifier.Start(g_hPanelChanged) != 0) {
+                LogDebug(L"ServiceMaster: Panel change notifications unavailable. Status block panel data is read once.");
+            }
+            bool powerAware = m_power.Start();
+            PublishPanelState();
+
+            // One full enumeration; from here on sessions are updated from their own events.
+            EnumerateSessions();
+            EnsureAllWorkers();
+            ArmRespawnTimer();
+
+            // Startup work is done; launches and session readiness re-arm the trim from here on.
+            m_footprint.Start(PublishMasterFootprint);
+            m_footprint.NotifyReady();
+
+            // Fixed wake sources first, then one process handle per tracked worker.
+            const DWORD NO_INDEX = MAXDWORD;
+            HANDLE handles[4 + MAX_WORKER_SLOTS];
+            DWORD sessionIds[MAX_WORKER_SLOTS];
+            DWORD firstWorkerIndex = 0;
+            handles[firstWorkerIndex++] = g_hWorkerSetChanged;
+            handles[firstWorkerIndex++] = g_hPanelChanged;
+            DWORD wakeIndex = NO_INDEX;
+            if (powerAware) {
+                wakeIndex = firstWorkerIndex;
+                handles[firstWorkerIndex++] = m_power.WakeEvent();
+            }
+            DWORD progressIndex = NO_INDEX;
+            if (StatusBlock::ChangedEvent()) {
+                progressIndex = firstWorkerIndex;
+                handles[firstWorkerIndex++] = StatusBlock::ChangedEvent();
+            }
+
+            LogDebug(L"Master Loop Active. Waiting for Session notifications, worker exits and wakes...");
+            while (true) {
+                DWORD count = firstWorkerIndex + CollectWorkerProcesses(handles + firstWorkerIndex, sessionIds, MAX_WORKER_SLOTS);
+
+                DWORD waitResult = MsgWaitForMultipleObjects(count, handles, FALSE, INFINITE, QS_ALLINPUT);
+                DWORD index = waitResult - WAIT_OBJECT_0;
+                if (index == 0) {
+                    if (InterlockedExchange(&g_ensureRequested, 0)) {
+                        EnsureAllWorkers();
+                        ArmRespawnTimer();
+                    }
+                    continue;
+                }
+                if (index == 1) {
+                    PublishPanelState();
+                    continue;
+                }
+                if (wakeIndex != NO_INDEX && index == wakeIndex) {
+                    OnWake();
+                    continue;
+                }
+                if (progressIndex != NO_INDEX && index == progressIndex) {
+                    if (AdvanceSessionStates()) m_footprint.NotifyReady();
+                    continue;
+                }
+                if (waitResult >= WAIT_OBJECT_0 + firstWorkerIndex && waitResult < WAIT_OBJECT_0 + count) {
+                    OnWorkerProcessExited(sessionIds[waitResult - WAIT_OBJECT_0 - firstWorkerIndex]);
+                    continue;
+                }
+                if (waitResult == WAIT_OBJECT_0 + count) {
+                    MSG msg;
+                    while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+                        if (msg.message == WM_QUIT) return;
+                        TranslateMessage(&msg);
+                        DispatchMessageW(&msg);
+                    }
+                    continue;
+                }
+
+                LogDebug(L"ServiceMaster: MsgWaitForMultipleObjects failed (Error: %d).", GetLastError());
+                return;
+            }
+        }
+
+    private:
+        bool RegisterSessionNotifications() {
+            if (WTSRegisterSessionNotification(m_hwnd, NOTIFY_FOR_ALL_SESSIONS)) return true;
+
+            DWORD dwErr = GetLastError();
+            if (dwErr != RPC_S_INVALID_BINDING) {
+                LogDebug(L"ServiceMaster: WTSRegisterSessionNotification failed (Error: %d).", dwErr);
+                return false;
+            }
+
+            // Terminal Services is not up yet (early boot). Wait for its ready event instead of retrying on a timer.
+            LogDebug(L"ServiceMaster: Terminal Services not ready. Waiting for %s...", TERMSRV_READY_EVENT_NAME);
+            HANDLE hTermSrvReady = OpenEventW(SYNCHRONIZE, FALSE, TERMSRV_READY_EVENT_NAME);
+            if (hTermSrvReady) {
+                WaitForSingleObject(hTermSrvReady, TERMSRV_READY_TIMEOUT_MS);
+                CloseHandle(hTermSrvReady);
+            }
+
+            if (WTSRegisterSessionNotification(m_hwnd, NOTIFY_FOR_ALL_SESSIONS)) return true;
+            LogDebug(L"ServiceMaster: WTSRegisterSessionNotification retry failed (Error: %d).", GetLastError());
+            return false;
+        }
+
+        void OnSessionChange(WPARAM reason, DWORD sessionId) {
+            if (!IsRelevantSessionEvent(reason)) return;
+
+            LogDebug(L"!!! WTS Session Change !!! Reason: 0x%X, Session: %d", (DWORD)reason, sessionId);
+
+            // A session that is going away must not get a respawn; release it right away.
+            if (reason == WTS_SESSION_LOGOFF || reason == WTS_SESSION_TERMINATE) {
+                UpdateSession(sessionId, WTSDown);
+                ReleaseLaunchContext(sessionId);
+                return;
+            }
+
+            QueueSession(sessionId);
+            if (m_debounceActive) return;
+
+            m_debounceActive = true;
+            SetTimer(m_hwnd, DEBOUNCE_TIMER_ID, WTS_DEBOUNCE_MS, NULL);
+            ProcessQueuedSessions();
+        }
+
+        void QueueSession(DWORD sessionId) {
+            for (DWORD i = 0; i < m_queuedCount; ++i) {
+                if (m_queuedSessions[i] == sessionId) return;
+            }
+            if (m_queuedCount < _countof(m_queuedSessions)) {
+                m_queuedSessions[m_queuedCount++] = sessionId;
+            }
+            else {
+                m_queueOverflowed = true;
+            }
+        }
+
+        // Refreshes only the sessions named by events since the last pass, then launches what is missing.
+        void ProcessQueuedSessions() {
+            if (m_queueOverflowed) {
+                EnumerateSessions();
+                DWORD sessionIds[MAX_WORKER_SLOTS];
+                DWORD count = 0;
+                AcquireSRWLockExclusive(&g_workerSlotLock);
+                for (size_t i = 0; i < g_workerSlotCount; ++i) {
+                    if (g_workerSlots[i].hProcess) sessionIds[count++] = g_workerSlots[i].SessionId;
+                }
+                ReleaseSRWLockExclusive(&g_workerSlotLock);
+                for (DWORD i = 0; i < count; ++i) SignalDesktopRespawn(sessionIds[i]);
+            }
+            else {
+                for (DWORD i = 0; i < m_queuedCount; ++i) {
+                    RefreshSession(m_queuedSessions[i]);
+                    SignalDesktopRespawn(m_queuedSessions[i]);
+                }
+            }
+            m_queuedCount = 0;
+            m_queueOverflowed = false;
+
+            StatusBlock::PublishActiveSession(WTSGetActiveConsoleSessionId());
+            EnsureAllWorkers();
+            ArmRespawnTimer();
+        }
+
+        // While a session is in crash-loop backoff, a timer relaunches it when the earliest backoff
+        // expires. With the display off the retry waits for the next wake.
+        void ArmRespawnTimer() {
+            DWORD backoffMs = NextBackoffExpiry();
+            if (backoffMs && m_power.IsDisplayOn()) {
+                SetTimer(m_hwnd, RESPAWN_TIMER_ID, backoffMs, NULL);
+            }
+        }
+
+        // Resume or display on: the panel override may have been reset and workers may have died
+        // while suspended, so re-check both now instead of waiting for a session event.
+        void OnWake() {
+            LogDebug(L"ServiceMaster: Wake. Re-checking panel state and workers.");
+            PublishPanelState();
+            EnsureAllWorkers();
+            ArmRespawnTimer();
+        }
+
+        void PublishPanelState() {
+            PanelManager::PanelState state;
+            if (PanelManager::QueryDisplayState(state) == 0) StatusBlock::PublishPanel(state);
+        }
+
+        void OnWorkerProcessExited(DWORD sessionId) {
+            OnWorkerExited(sessionId);
+            EnsureWorkers(sessionId);
+            ArmRespawnTimer();
+        }
+
+        void OnRespawnElapsed() {
+            KillTimer(m_hwnd, RESPAWN_TIMER_ID);
+            EnsureAllWorkers();
+            ArmRespawnTimer();
+        }
+
+        void OnDebounceElapsed() {
+            KillTimer(m_hwnd, DEBOUNCE_TIMER_ID);
+            m_debounceActive = false;
+
+            if (m_queuedCount || m_queueOverflowed) {
+                LogDebug(L"Debounce window closed. Re-checking %u coalesced session(s).", m_queuedCount);
+                ProcessQueuedSessions();
+            }
+        }
+
+        static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+            if (msg == WM_NCCREATE) {
+                auto pCreate = reinterpret_cast<CREATESTRUCTW*>(lParam);
+                SetWindowLongPtrW(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(pCreate->lpCreateParams));
+            }
+
+            auto pMaster = reinterpret_cast<ServiceMaster*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+            if (pMaster) {
+                switch (msg) {
+                case WM_WTSSESSION_CHANGE:
+                    pMaster->OnSessionChange(wParam, (DWORD)lParam);
+                    return 0;
+                case WM_TIMER:
+                    if (wParam == DEBOUNCE_TIMER_ID) {
+                        pMaster->OnDebounceElapsed();
+                        return 0;
+                    }
+                    if (wParam == RESPAWN_TIMER_ID) {
+                        pMaster->OnRespawnElapsed();
+                        return 0;
+                    }
+                    break;
+                }
+            }
+            return DefWindowProcW(hwnd, msg, wParam, lParam);
+        }
+
+        HWND m_hwnd = NULL;
+        PanelManager::DisplaySizeChangeNotifier m_panelNotifier;
+        Power::Monitor m_power;
+        Footprint::Trimmer m_footprint;
+        bool m_notificationsRegistered = false;
+        bool m_debounceActive = false;
+        DWORD m_queuedSessions[MAX_WORKER_SLOTS] = {};
+        DWORD m_queuedCount = 0;
+        bool m_queueOverflowed = false;
+    };
+
+    // Used when window-based session notifications are unavailable.
+    void RunEventLoopFallback() {
+        DWORD eventFlag = 0;
+        ULONGLONG lastHandled = 0;
+
+        LogDebug(L"Master Loop Active (fallback). Waiting for filtered WTS events...");
+
+        while (true) {
+            PanelManager::PanelState panel;
+            if (PanelManager::QueryDisplayState(panel) == 0) StatusBlock::PublishPanel(panel);
+            StatusBlock::PublishActiveSession(WTSGetActiveConsoleSessionId());
+            EnumerateSessions();
+            EnsureAllWorkers();
+
+            LogDebug(L"Entering WTSWaitSystemEvent (Blocking wait)...");
+
+            if (WTSWaitSystemEvent(WTS_CURRENT_SERVER_HANDLE, MASTER_WTS_EVENT_MASK, &eventFlag)) {
+                LogDebug(L"!!! WTS Event Received !!! Flag: 0x%X", eventFlag);
+                eventFlag = 0;
+
+                // Handle the first event of a burst immediately; only throttle follow-ups.
+                ULONGLONG now = GetTickCount64();
+                if (now - lastHandled < WTS_DEBOUNCE_MS) {
+                    Sleep((DWORD)(WTS_DEBOUNCE_MS - (now - lastHandled)));
+                }
+                lastHandled = GetTickCount64();
+            }
+            else {
+                LogDebug(L"Error: WTSWaitSystemEvent failed. Code: %d", GetLastError());
+                Sleep(2000);
+            }
+        }
+    }
+
+    int RunService(const ServiceOptions& options) {
         DWORD currentSessionId;
         ProcessIdToSessionId(GetCurrentProcessId(), &currentSessionId);
 
         if (currentSessionId != 0) {
-            RunTouchLogic();
+            RunSessionWorker(options);
             return 0;
         }
 
         LogDebug(L"--- RunService() Master Started (Session 0) ---");
+        InitializeLaunchCommandLine(options);
+        g_hWorkerSetChanged = CreateEventW(NULL, FALSE, FALSE, NULL);
+        g_hPanelChanged = CreateEventW(NULL, FALSE, FALSE, NULL);
+        Trace::Milestone(L"TouchService", L"MasterStarted", 0);
 
         HANDLE hMasterMutex = CreateMutexW(NULL, TRUE, MASTER_MUTEX_NAME);
 
@@ -276,39 +1501,27 @@ namespace TouchManager {
             return 0;
         }
 
-        const std::vector<LPCWSTR> targetDesktops = { L"winsta0\\default", L"winsta0\\winlogon" };
-        DWORD eventFlag = 0;
-
-        LogDebug(L"Master Loop Active. Waiting for Session events...");
-
-        while (true) {
-            DWORD activeSessionId = WTSGetActiveConsoleSessionId();
-
-            LogDebug(L"Loop check: Active Session is %d", activeSessionId);
+        if (!StatusBlock::Create()) {
+            LogDebug(L"Warning: Status block unavailable. Continuing without it.");
+        }
 
-            if (activeSessionId != 0xFFFFFFFF && activeSessionId != 0) {
-                for (const auto& desktop : targetDesktops) {
-                    if (!IsWorkerRunning(activeSessionId, desktop)) {
-                        LogDebug(L"Monitor: Worker missing on Session %d [%s]. Launching...", activeSessionId, desktop);
-                        LaunchAsSystemInSession(activeSessionId, desktop);
-                    }
-                }
+        {
+            ControlService::Server controlServer;
+            if (!controlServer.Start()) {
+                LogDebug(L"Warning: Control pipe unavailable. Continuing without it.");
             }
 
-            LogDebug(L"Entering WTSWaitSystemEvent (Blocking wait)...");
-
-            if (WTSWaitSystemEvent(WTS_CURRENT_SERVER_HANDLE, WTS_EVENT_ALL, &eventFlag)) {
-                LogDebug(L"!!! WTS Event Received !!! Flag: 0x%X", eventFlag);
-
-                eventFlag = 0;
-                Sleep(500);
+            ServiceMaster master;
+            if (master.Create()) {
+                master.Run();
             }
             else {
-                LogDebug(L"Error: WTSWaitSystemEvent failed. Code: %d", GetLastError());
-                Sleep(2000);
+                RunEventLoopFallback();
             }
         }
 
+        ReleaseAllLaunchContexts();
+        StatusBlock::Close();
         ReleaseMutex(hMasterMutex);
         CloseHandle(hMasterMutex);
         LogDebug(L"--- RunService() Ended ---");
@@ -18,5 +18,20 @@
 #include "PanelManager.h"
 
 namespace TouchManager {
-    int RunService();
+    struct ServiceOptions {
+        bool GamepadTouch = false; // --gamepad-touch: workers turn controller input into touch contacts.
+    };
+
+    // The master forwards its options to every session worker it launches.
+    int RunService(const ServiceOptions& options = {});
+
+    // Master-side worker control, shared with the control pipe.
+    bool IsWorkerRunning(DWORD sessionId);
+
+    // Asynchronous: signals the worker to exit (the master respawns it) or asks the master to launch one.
+    bool RestartWorkers(DWORD sessionId);
+
+    // Bench hook: injects one probe contact from the calling thread's desktop, initializing
+    // injection on first use. Returns false when injection is unavailable or rejected.
+    bool InjectProbeContact();
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "pch.h"
+#include "Trace.h"
+#include <TraceLoggingProvider.h>
+
+// {3A03B59D-5FDD-5F67-FDDD-7D43DAE8C1D6}, derived from the provider name (EventSource convention).
+TRACELOGGING_DEFINE_PROVIDER(
+    g_hTraceProvider,
+    "XFEST.PhysPanelCPP",
+    (0x3a03b59d, 0x5fdd, 0x5f67, 0xfd, 0xdd, 0x7d, 0x43, 0xda, 0xe8, 0xc1, 0xd6));
+
+namespace Trace {
+
+    LARGE_INTEGER g_frequency = { 0 };
+
+    void Register() {
+        QueryPerformanceFrequency(&g_frequency);
+        TraceLoggingRegister(g_hTraceProvider);
+    }
+
+    void Unregister() {
+        TraceLoggingUnregister(g_hTraceProvider);
+    }
+
+    LONGLONG Timestamp() {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return now.QuadPart;
+    }
+
+    LONGLONG ElapsedUs(LONGLONG startTimestamp) {
+        if (g_frequency.QuadPart == 0) QueryPerformanceFrequency(&g_frequency);
+        return (Timestamp() - startTimestamp) * 1000000 / g_frequency.QuadPart;
+    }
+
+    LONGLONG ElapsedNs(LONGLONG startTimestamp) {
+        if (g_frequency.QuadPart == 0) QueryPerformanceFrequency(&g_frequency);
+        return (Timestamp() - startTimestamp) * 1000000000 / g_frequency.QuadPart;
+    }
+
+    void Phase(const wchar_t* component, const wchar_t* phase, LONGLONG startTimestamp, DWORD status) {
+        if (!TraceLoggingProviderEnabled(g_hTraceProvider, 0, 0)) return;
+
+        TraceLoggingWrite(g_hTraceProvider, "Phase",
+            TraceLoggingWideString(component, "Component"),
+            TraceLoggingWideString(phase, "Phase"),
+            TraceLoggingInt64(ElapsedUs(startTimestamp), "DurationUs"),
+            TraceLoggingHexUInt32(status, "Status"),
+            TraceLoggingUInt32(GetCurrentProcessId(), "ProcessId"));
+    }
+
+    void Milestone(const wchar_t* component, const wchar_t* name, DWORD status) {
+        if (!TraceLoggingProviderEnabled(g_hTraceProvider, 0, 0)) return;
+
+        DWORD sessionId = 0;
+        ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+
+        TraceLoggingWrite(g_hTraceProvider, "Milestone",
+            TraceLoggingWideString(component, "Component"),
+            TraceLoggingWideString(name, "Name"),
+            TraceLoggingUInt64(GetTickCount64(), "UptimeMs"),
+            TraceLoggingHexUInt32(status, "Status"),
+            TraceLoggingUInt32(sessionId, "SessionId"));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+// Xbox Full Screen Experience Tool
+// Copyright (C) 2025 8bit2qubit
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+#include "pch.h"
+
+// Release-safe ETW tracing (TraceLogging provider "XFEST.PhysPanelCPP").
+// Events are dropped at near-zero cost when no session is listening, so they stay compiled in
+// Release builds. Capture with: wpr -start <profile with provider *XFEST.PhysPanelCPP> ... wpr -stop trace.etl
+namespace Trace {
+
+    void Register();
+
+    void Unregister();
+
+    // Monotonic timestamp in QueryPerformanceCounter ticks.
+    LONGLONG Timestamp();
+
+    LONGLONG ElapsedUs(LONGLONG startTimestamp);
+
+    LONGLONG ElapsedNs(LONGLONG startTimestamp);
+
+    // One event per completed phase, carrying its duration and result code.
+    void Phase(const wchar_t* component, const wchar_t* phase, LONGLONG startTimestamp, DWORD status);
+
+    // Point-in-time event carrying the system uptime, e.g. "TouchReady" or "KeyboardReady",
+    // so boot-to-ready can be read directly from a field trace.
+    void Milestone(const wchar_t* component, const wchar_t* name, DWORD status);
+
+    class PhaseScope {
+    public:
+        PhaseScope(const wchar_t* component, const wchar_t* phase)
+            : m_component(component), m_phase(phase), m_start(Timestamp()) {}
+
+        ~PhaseScope() { Phase(m_component, m_phase, m_start, m_status); }
+
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+
+        void SetStatus(DWORD status) { m_status = status; }
+
+    private:
+        const wchar_t* m_component;
+        const wchar_t* m_phase;
+        LONGLONG m_start;
+        DWORD m_status = 0;
+    };
+}
\ No newline at end of file
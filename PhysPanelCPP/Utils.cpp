@@ -16,6 +16,8 @@
 
 #include "pch.h"
 #include "Utils.h"
+#include <atomic>
+#include <string>
 #include <vector>
 
 bool GetAppVersion(wchar_t* buffer, size_t size) {
@@ -56,15 +58,251 @@ bool GetAppVersion(wchar_t* buffer, size_t size) {
     return false;
 }
 
-void LogDebug(const wchar_t* format, ...) {
+namespace {
+
+    const size_t LOG_QUEUE_CAPACITY = 1024; // Must be a power of two.
+    const size_t LOG_RECORD_CHARS = 256;
+    const LONGLONG LOG_ROLL_SIZE_BYTES = 1024 * 1024;
+
+    struct LogRecord {
+        std::atomic<size_t> sequence;
+        ULONGLONG timestamp;
+        DWORD threadId;
+        wchar_t text[LOG_RECORD_CHARS];
+    };
+
+    // Bounded multi-producer / single-consumer ring (sequence-numbered cells). Producers never block:
+    // when the ring is full the record is dropped and counted, so logging cannot stall a hot path.
+    class LogQueue {
+    public:
+        LogQueue() : m_cells(new LogRecord[LOG_QUEUE_CAPACITY]) {
+            for (size_t i = 0; i < LOG_QUEUE_CAPACITY; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~LogQueue() { delete[] m_cells; }
+
+        LogRecord* BeginPush(size_t& cellPos) {
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                LogRecord* cell = &m_cells[pos & (LOG_QUEUE_CAPACITY - 1)];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cellPos = pos;
+                        return cell;
+                    }
+                }
+                else if (diff < 0) {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                else {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void EndPush(LogRecord* cell, size_t cellPos) {
+            cell->sequence.store(cellPos + 1, std::memory_order_release);
+        }
+
+        // Single consumer only (the writer thread).
+        const LogRecord* Front() {
+            LogRecord* cell = &m_cells[m_dequeuePos & (LOG_QUEUE_CAPACITY - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            return (seq == m_dequeuePos + 1) ? cell : nullptr;
+        }
+
+        void Pop() {
+            LogRecord* cell = &m_cells[m_dequeuePos & (LOG_QUEUE_CAPACITY - 1)];
+            cell->sequence.store(m_dequeuePos + LOG_QUEUE_CAPACITY, std::memory_order_release);
+            ++m_dequeuePos;
+        }
+
+        size_t TakeDropped() {
+            return m_dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+    private:
+        LogRecord* m_cells;
+        std::atomic<size_t> m_enqueuePos{ 0 };
+        std::atomic<size_t> m_dropped{ 0 };
+        size_t m_dequeuePos = 0;
+    };
+
+    LogQueue* g_logQueue = nullptr;
+    std::atomic<bool> g_logEnabled{ false };
+    std::atomic<LONG> g_logSignalPending{ 0 };
+    std::atomic<bool> g_logStopping{ false };
+    HANDLE g_logWakeEvent = NULL;
+    HANDLE g_logThread = NULL;
+    HANDLE g_logFile = INVALID_HANDLE_VALUE;
+    std::wstring g_logPath;
+
+    HANDLE OpenLogFile() {
+        return CreateFileW(g_logPath.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+
+    void RollLogFileIfNeeded() {
+        LARGE_INTEGER size = { 0 };
+        if (g_logFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(g_logFile, &size) || size.QuadPart < LOG_ROLL_SIZE_BYTES) return;
+
+        CloseHandle(g_logFile);
+        std::wstring rolledPath = g_logPath + L".1";
+        MoveFileExW(g_logPath.c_str(), rolledPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+        g_logFile = OpenLogFile();
+    }
+
+    void AppendRecord(std::string& batch, const LogRecord& record) {
+        FILETIME ft;
+        ft.dwLowDateTime = (DWORD)(record.timestamp & 0xFFFFFFFF);
+        ft.dwHighDateTime = (DWORD)(record.timestamp >> 32);
+        FILETIME localFt;
+        SYSTEMTIME st;
+        FileTimeToLocalFileTime(&ft, &localFt);
+        FileTimeToSystemTime(&localFt, &st);
+
+        char prefix[64];
+        int prefixLen = sprintf_s(prefix, "%02u:%02u:%02u.%03u [%lu:%lu] ",
+            st.wHour, st.wMinute, st.wSecond, st.wMilliseconds, GetCurrentProcessId(), record.threadId);
+        if (prefixLen > 0) batch.append(prefix, prefixLen);
+
+        char text[LOG_RECORD_CHARS * 3];
+        int textLen = WideCharToMultiByte(CP_UTF8, 0, record.text, -1, text, sizeof(text), NULL, NULL);
+        if (textLen > 1) batch.append(text, textLen - 1);
+        batch.append("\r\n");
+    }
+
+    DWORD WINAPI LogWriterThreadProc(LPVOID) {
+        std::string batch;
+        batch.reserve(64 * 1024);
+
+        while (true) {
+            // No timeout: producers signal after every drain and shutdown signals too, so an idle
+            // resident process never wakes this thread.
+            WaitForSingleObject(g_logWakeEvent, INFINITE);
+            // Acquire pairs with the producers' exchange, so records pushed by a producer that saw the flag
+            // still set (and skipped the signal) are visible to the drain below.
+            g_logSignalPending.exchange(0, std::memory_order_acq_rel);
+            bool stopping = g_logStopping.load(std::memory_order_acquire);
+
+            batch.clear();
+            const LogRecord* record;
+            while ((record = g_logQueue->Front()) != nullptr) {
+                AppendRecord(batch, *record);
 #if defined(_DEBUG)
+                wprintf(L"[Debug] %s\n", record->text);
+#endif
+                g_logQueue->Pop();
+            }
+
+            size_t dropped = g_logQueue->TakeDropped();
+            if (dropped) {
+                char note[64];
+                int noteLen = sprintf_s(note, "(%zu log records dropped: queue full)\r\n", dropped);
+                if (noteLen > 0) batch.append(note, noteLen);
+            }
+
+            if (!batch.empty() && g_logFile != INVALID_HANDLE_VALUE) {
+                DWORD written = 0;
+                WriteFile(g_logFile, batch.data(), (DWORD)batch.size(), &written, NULL);
+                RollLogFileIfNeeded();
+            }
+
+            if (stopping) break;
+        }
+        return 0;
+    }
+
+    bool IsLoggingRequested() {
+#if defined(_DEBUG)
+        return true;
+#else
+        wchar_t value[8] = { 0 };
+        DWORD len = GetEnvironmentVariableW(L"XFEST_DIAGNOSTIC_LOG", value, _countof(value));
+        return len > 0 && len < _countof(value) && wcscmp(value, L"0") != 0;
+#endif
+    }
+}
+
+void InitializeLogging(const wchar_t* component) {
+    if (g_logQueue || !IsLoggingRequested()) return;
+
+    wchar_t tempPath[MAX_PATH];
+    DWORD tempLen = GetTempPathW(MAX_PATH, tempPath);
+    if (tempLen > 0 && tempLen < MAX_PATH) {
+        DWORD sessionId = 0;
+        ProcessIdToSessionId(GetCurrentProcessId(), &sessionId);
+
+        std::wstring name = component ? component : L"main";
+        if (name.size() > 32) name.resize(32);
+        for (auto& c : name) {
+            if (!iswalnum(c)) c = L'_';
+        }
+
+        std::wstring logDir = std::wstring(tempPath) + L"XFEST_Logs";
+        CreateDirectoryW(logDir.c_str(), NULL);
+        g_logPath = logDir + L"\\PhysPanelCPP_" + name + L"_S" + std::to_wstring(sessionId) + L".log";
+        g_logFile = OpenLogFile();
+    }
+
+    g_logQueue = new LogQueue();
+    g_logWakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    g_logThread = CreateThread(NULL, 0, LogWriterThreadProc, NULL, 0, NULL);
+    if (!g_logWakeEvent || !g_logThread) {
+        if (g_logThread) CloseHandle(g_logThread);
+        if (g_logWakeEvent) CloseHandle(g_logWakeEvent);
+        g_logThread = NULL;
+        g_logWakeEvent = NULL;
+        return;
+    }
+
+    SetThreadPriority(g_logThread, THREAD_PRIORITY_BELOW_NORMAL);
+    g_logEnabled.store(true, std::memory_order_release);
+}
+
+void ShutdownLogging() {
+    if (!g_logEnabled.exchange(false)) return;
+
+    g_logStopping.store(true, std::memory_order_release);
+    SetEvent(g_logWakeEvent);
+    WaitForSingleObject(g_logThread, 2000);
+    CloseHandle(g_logThread);
+    CloseHandle(g_logWakeEvent);
+    g_logThread = NULL;
+    g_logWakeEvent = NULL;
+
+    if (g_logFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(g_logFile);
+        g_logFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+void LogDebug(const wchar_t* format, ...) {
+    if (!g_logEnabled.load(std::memory_order_acquire)) return;
+
+    size_t cellPos = 0;
+    LogRecord* cell = g_logQueue->BeginPush(cellPos);
+    if (!cell) return;
+
+    ULONGLONG timestamp;
+    GetSystemTimePreciseAsFileTime(reinterpret_cast<FILETIME*>(&timestamp));
+    cell->timestamp = timestamp;
+    cell->threadId = GetCurrentThreadId();
+
     va_list args;
     va_start(args, format);
-    wprintf(L"[Debug] ");
-    vwprintf(format, args);
-    wprintf(L"\n");
+    _vsnwprintf_s(cell->text, LOG_RECORD_CHARS, _TRUNCATE, format, args);
     va_end(args);
-#else
-    UNREFERENCED_PARAMETER(format);
-#endif
+
+    g_logQueue->EndPush(cell, cellPos);
+
+    // Only the first producer after a drain pays for the wakeup.
+    if (g_logSignalPending.exchange(1, std::memory_order_acq_rel) == 0) {
+        SetEvent(g_logWakeEvent);
+    }
 }
\ No newline at end of file
@@ -19,4 +19,12 @@
 
 bool GetAppVersion(wchar_t* buffer, size_t size);
 
+// Starts the asynchronous log sink. Always on in Debug builds (console + file); in Release builds
+// only when the XFEST_DIAGNOSTIC_LOG environment variable is set to a non-zero value.
+// Records are written to %TEMP%\XFEST_Logs\PhysPanelCPP_<component>_S<session>.log.
+void InitializeLogging(const wchar_t* component);
+
+// Flushes pending records and stops the writer thread.
+void ShutdownLogging();
+
 void LogDebug(const wchar_t* format, ...);
\ No newline at end of file
@@ -16,12 +16,15 @@
 
 #pragma once
 
-// Windows and COM
-#include <comdef.h>
-#include <ShlObj.h>
-#include <TlHelp32.h>
+// Windows. Subsystem headers (COM, shell, ToolHelp) are included by the modules that use them
+// so the headless panel commands stay free of them; their DLLs are delay-loaded (see vcxproj).
+#include <windows.h>
+#include <winternl.h>
 
 // C/C++ Standard Library
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
 #include <cmath>
 #include <chrono>
 #include <thread>
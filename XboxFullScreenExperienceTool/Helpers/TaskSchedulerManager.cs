@@ -211,7 +211,7 @@ namespace XboxFullScreenExperienceTool.Helpers
         /// <summary>
         /// 建立或覆寫 SetPanelDimensions 工作排程。
         /// </summary>
-        /// <param name="regOnly">如果為 true，則僅執行 'reg' 指令 (適用於 Native Build：26100.8328+ / 26200.8328+ / 26220.7271+ / 28020.1362+)；否則執行標準的 'set 155 87 reg'。</param>
+        /// <param name="regOnly">如果為 true，則僅執行 'reg' 指令 (適用於 Native Build：26100.8328+ / 26200.8328+ / 26220.7271+ / 28020.1362+)；否則執行常駐的 'watch 155 87 reg'，在尺寸覆寫被系統改寫時立即重新套用。</param>
         /// <exception cref="FileNotFoundException">如果找不到 `PhysPanelCS.exe`，則擲出此例外狀況。</exception>
         /// <exception cref="Exception">如果 `schtasks.exe` 命令因任何其他原因失敗，則擲出此例外狀況。</exception>
         public static void CreateSetPanelDimensionsTask(bool regOnly = false)
@@ -223,8 +223,9 @@ namespace XboxFullScreenExperienceTool.Helpers
                 throw new FileNotFoundException(string.Format(Resources.Strings.TaskSchedulerManagerErrorFindFile, physPanelPath));
             }
 
-            // 若 regOnly 為 true，參數僅為 "reg"，否則維持原有的 "set 155 87 reg"
-            string arguments = regOnly ? "reg" : "set 155 87 reg";
+            // 若 regOnly 為 true，參數僅為 "reg"，否則使用常駐的 "watch 155 87 reg" (訂閱 WNF 變更，取代每次開機單次寫入)
+            // --quiet：開機工作無人檢視輸出，避免 set/reg 的成功訊息建立主控台視窗 (結果以結束代碼判斷)
+            string arguments = regOnly ? "--quiet reg" : "--quiet watch 155 87 reg";
 
             // 使用 XML 定義工作排程。這種方法比使用一長串命令列參數更精確且可靠。
             string xmlContent = $@"<?xml version=""1.0"" encoding=""UTF-16""?>
@@ -259,8 +260,10 @@ namespace XboxFullScreenExperienceTool.Helpers
     <RunOnlyIfNetworkAvailable>false</RunOnlyIfNetworkAvailable>
     <Enabled>true</Enabled>
     <Hidden>false</Hidden>
-    <!-- 優先級：0 (REALTIME_PRIORITY_CLASS)，確保開機後第一時間修改實體顯示面板設定 -->
-    <Priority>0</Priority>
+    <!-- 執行時間限制：PT0S (無限制)，watch 模式需常駐，不可被預設的 72 小時限制終止 -->
+    <ExecutionTimeLimit>PT0S</ExecutionTimeLimit>
+    <!-- 優先級：4 (NORMAL_PRIORITY_CLASS)，watch 模式為常駐程序，不可以即時優先級長期執行 -->
+    <Priority>4</Priority>
   </Settings>
   <Actions Context=""Author"">
     <Exec>
@@ -419,7 +422,12 @@ namespace XboxFullScreenExperienceTool.Helpers
             // 這裡不檢查 ExitCode，因為如果工作本來就沒在執行，指令會回傳錯誤，這是可接受的。
         }
 
-        public static void DeleteSetPanelDimensionsTask() => DeleteTask(TASK_NAME);
+        public static void DeleteSetPanelDimensionsTask()
+        {
+            // watch 模式為常駐程序，刪除工作排程前先停止正在執行的實例
+            EndTask(TASK_NAME);
+            DeleteTask(TASK_NAME);
+        }
         public static void DeleteSimulateTouchTask() => DeleteTask(SIMULATE_TOUCH_TASK_NAME);
 
         // 保留此方法以清除舊版工作 (例如在靜默解除安裝時)